@@ -19,26 +19,30 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 '''
 
 import argparse
+from array import array
+from collections import deque
+from ctypes import byref, c_char_p, c_double, c_int, c_size_t, c_void_p, CDLL, POINTER
 from datetime import datetime, timedelta
-from math import isnan
-from os import rename
-from os.path import dirname, exists, join, realpath
-from pickle import dump, load
+from glob import glob
+from heapq import heappop, heappush
+import json
+from math import exp, isnan, log
+from os import environ, fsync, read, replace, set_blocking, write
+from os.path import abspath, basename, dirname, exists, join, realpath
+from pickle import load
+from queue import Empty, Queue
 from random import choice, randint
+from select import select
 import shlex
+from socket import socket, AF_UNIX, SOCK_STREAM
+from struct import calcsize, pack, unpack
 from subprocess import Popen, PIPE
 from sys import path, stdout
-from time import sleep
+from threading import Condition, Thread
+from time import sleep, time
 
+# only needed for reading pickled restart files of old versions
 path.append(join(dirname(realpath(__file__)), 'submodules/ndgrid/source'))
-try:
-	from cell import cell
-	from ndgrid import ndgrid
-except Exception as e:
-	print("Couldn't import required submodule(s): ", e)
-	print("Did you remember to clone them along with hdintegrator by using:")
-	print('git clone --recursive https://github.com/iljah/hdintegrator.git')
-	exit(1)
 
 try:
 	from mpi4py import MPI
@@ -46,41 +50,590 @@ except Exception as e:
 	exit("Couldn't import mpi4py: " + str(e))
 
 
+'''
+Integration grid storing cells in arrays instead of one object per cell.
+
+\param dimensions Number of dimensions
+
+\var totals Results of cells removed from grid: 'converged-volume', 'nan-volume', 'value', 'error' and 'nr-cells'
+\var slots Dictionary of cell id -> index of cell in arrays below
+\var ids Id of cell at every index, None if index is unused
+\var extents Minimum and maximum extent of cell in every dimension, 2 * dimensions values per index
+\var flags Bit mask of PROCESSING, CONVERGED, HAS_VALUE, HAS_ERROR and HAS_ESTIMATE per index
+\var values Value of cell's integral per index
+\var errors Absolute error of cell's integral per index
+\var estimates Estimated value and absolute error of cell's integral, 2 values per index
+\var free Unused indices
+
+Cells are refered to by id, indices of removed cells are reused by new cells.
+Converged cells are removed to conserve memory after adding their result to
+totals. Properties of cells are accessed with get() and set() using names
+'processing', 'converged', 'value', 'error' and 'estimate', unset value,
+error or estimate being None.
+'''
+class Cell_Store:
+	PROCESSING = 1
+	CONVERGED = 2
+	HAS_VALUE = 4
+	HAS_ERROR = 8
+	HAS_ESTIMATE = 16
+
+	def __init__(self, dimensions):
+		self.dimensions = dimensions
+		self.totals = {
+			'converged-volume': 0.0,
+			'nan-volume': 0.0,
+			'value': 0.0,
+			'error': 0.0,
+			'nr-cells': 0
+		}
+		self.slots = {}
+		self.ids = []
+		self.extents = array('d')
+		self.flags = array('B')
+		self.values = array('d')
+		self.errors = array('d')
+		self.estimates = array('d')
+		self.free = []
+
+	def __len__(self):
+		return len(self.slots)
+
+	def __contains__(self, cell_id):
+		return cell_id in self.slots
+
+	'''
+	Adds cell with given id and list of minimum and maximum extents to grid.
+	'''
+	def add(self, cell_id, extents):
+		if len(self.free) > 0:
+			slot = self.free.pop()
+			self.ids[slot] = cell_id
+			self.flags[slot] = 0
+			for dim in range(self.dimensions):
+				self.extents[2 * (slot * self.dimensions + dim)] = extents[dim][0]
+				self.extents[2 * (slot * self.dimensions + dim) + 1] = extents[dim][1]
+		else:
+			slot = len(self.ids)
+			self.ids.append(cell_id)
+			self.flags.append(0)
+			self.values.append(0.0)
+			self.errors.append(0.0)
+			self.estimates.extend((0.0, 0.0))
+			for extent in extents:
+				self.extents.extend((extent[0], extent[1]))
+		self.slots[cell_id] = slot
+
+	'''
+	Removes cell with given id from grid.
+	'''
+	def remove(self, cell_id):
+		slot = self.slots.pop(cell_id)
+		self.ids[slot] = None
+		self.free.append(slot)
+
+	'''
+	Returns list of ids of cells in grid.
+	'''
+	def get_cells(self):
+		return list(self.slots)
+
+	'''
+	Returns minimum and maximum extent of given cell in given dimension.
+	'''
+	def get_extent(self, cell_id, dim):
+		index = 2 * (self.slots[cell_id] * self.dimensions + dim)
+		return self.extents[index], self.extents[index + 1]
+
+	'''
+	Returns list of minimum and maximum extent of given cell in every dimension.
+	'''
+	def get_extents(self, cell_id):
+		return [self.get_extent(cell_id, dim) for dim in range(self.dimensions)]
+
+	'''
+	Returns volume of given cell.
+	'''
+	def get_volume(self, cell_id):
+		vol = 1.0
+		for extent in self.get_extents(cell_id):
+			vol *= extent[1] - extent[0]
+		return vol
+
+	'''
+	Returns property with given name of given cell.
+	'''
+	def get(self, cell_id, name):
+		slot = self.slots[cell_id]
+		flags = self.flags[slot]
+		if name == 'processing':
+			return flags & self.PROCESSING != 0
+		elif name == 'converged':
+			return flags & self.CONVERGED != 0
+		elif name == 'value':
+			return self.values[slot] if flags & self.HAS_VALUE else None
+		elif name == 'error':
+			return self.errors[slot] if flags & self.HAS_ERROR else None
+		elif name == 'estimate':
+			if flags & self.HAS_ESTIMATE:
+				return self.estimates[2 * slot], self.estimates[2 * slot + 1]
+			return None
+		raise KeyError(name)
+
+	'''
+	Sets property with given name of given cell.
+	'''
+	def set(self, cell_id, name, value):
+		slot = self.slots[cell_id]
+		is_set = value != None
+		if name == 'processing':
+			flag = self.PROCESSING
+			is_set = value
+		elif name == 'converged':
+			flag = self.CONVERGED
+			is_set = value
+		elif name == 'value':
+			flag = self.HAS_VALUE
+			if is_set:
+				self.values[slot] = value
+		elif name == 'error':
+			flag = self.HAS_ERROR
+			if is_set:
+				self.errors[slot] = value
+		elif name == 'estimate':
+			flag = self.HAS_ESTIMATE
+			if is_set:
+				self.estimates[2 * slot], self.estimates[2 * slot + 1] = value
+		else:
+			raise KeyError(name)
+		if is_set:
+			self.flags[slot] |= flag
+		else:
+			self.flags[slot] &= ~flag
+
+	'''
+	Replaces given cell with two cells that are halves of it in given dimension.
+
+	Children aren't processing or converged and have no value, error or
+	estimate, ID of child cell is parent id * 2 + (0 or 1).
+
+	\return List of ids of children.
+	'''
+	def split(self, cell_id, dim):
+		extents = self.get_extents(cell_id)
+		self.remove(cell_id)
+		minimum, maximum = extents[dim]
+		middle = (minimum + maximum) / 2
+		extents[dim] = (minimum, middle)
+		self.add(cell_id * 2, extents)
+		extents[dim] = (middle, maximum)
+		self.add(cell_id * 2 + 1, extents)
+		return [cell_id * 2, cell_id * 2 + 1]
+
+
 '''
 Splits a cell.
 
-\param cell Cell to split
+\param cell_id Id of cell to split
 \param splits Number of times to split given cell, it's children, etc.
 \param dimensions List of dimensions in which to split
-\param grid Grid in which to split given cell.
+\param grid Cell_Store in which to split given cell.
+\param journal Journal in which to record splits, if any.
 
-ID of child cell is parent id * 2 + (0 or 1).
+\return List of ids of cells that replaced given cell in grid.
 '''
-def split(cell, splits, dimensions, grid):
-	# TODO logging
-	cells_to_split = [cell]
+def split(cell_id, splits, dimensions, grid, journal = None):
+	cells_to_split = [cell_id]
 	new_cells_to_split = []
 	for dim in dimensions:
 		for i in range(splits):
 			for c_to_split in cells_to_split:
-				old_id = c_to_split.data['id']
-				for new_cell in grid.split(c_to_split, dim):
-					new_cells_to_split.append(new_cell)
-				new_cells_to_split[-2].data['id'] = old_id * 2
-				new_cells_to_split[-1].data['id'] = old_id * 2 + 1
+				if journal != None:
+					journal.split(c_to_split, dim)
+				new_cells_to_split.extend(grid.split(c_to_split, dim))
 			cells_to_split = new_cells_to_split
 			new_cells_to_split = []
+	return cells_to_split
+
+
+'''
+Splits cells of grid that haven't converged until there are at least given number of them.
+
+\param grid Grid in which to split cells
+\param nr_cells Minimum number of cells that haven't converged
+\param dimensions List of dimensions in which to split
+\param journal Journal in which to record splits, if any.
+
+Oldest cells are split first and in dimension given by their depth in the
+tree of cells so that resulting cells are of similar size.
+'''
+def split_until(grid, nr_cells, dimensions, journal = None):
+	cells = deque([c for c in grid.get_cells() if not grid.get(c, 'converged')])
+	while 0 < len(cells) < nr_cells:
+		c = cells.popleft()
+		depth = c.bit_length() - 1
+		cells.extend(split(c, 1, [dimensions[depth % len(dimensions)]], grid, journal))
+
+
+'''
+Returns ranks that give work to other ranks along with the ranks they give work to.
+
+\param size Number of ranks
+\param group_size Number of workers per sub-master, no sub-masters if < 1
+
+\return List of (master, workers) tuples, master is 0 if there are no sub-masters.
+
+Ranks after 0 are divided into consecutive groups of a sub-master followed
+by its workers, last group might be smaller.
+'''
+def get_groups(size, group_size):
+	if group_size < 1:
+		return [(0, list(range(1, size)))]
+	groups = []
+	for first in range(1, size, group_size + 1):
+		ranks = list(range(first, min(size, first + group_size + 1)))
+		if len(ranks) < 2 and len(groups) > 0:
+			groups[-1][1].extend(ranks)
+		else:
+			groups.append((ranks[0], ranks[1:]))
+	return groups
+
+
+'''
+Restart file format.
+
+File starts with JOURNAL_MAGIC, version and number of dimensions followed
+by minimum and maximum extent of root cell (id 1) in every dimension.
+After that come records, each starting with one byte giving its kind:
+	T: totals of removed cells (converged volume, NaN volume, value, error, number of cells), replaces earlier totals
+	S: cell was split, followed by cell id and dimension
+	C: cell converged and was removed, followed by cell id and what it added to totals
+	R: cell was removed, its result is already included in totals
+Cell ids are stored as one byte giving their length followed by the id in
+big endian byte order. An incomplete record at end of file is ignored.
+'''
+JOURNAL_MAGIC = b'HDIJ'
+JOURNAL_VERSION = 1
+JOURNAL_HEADER = '<BH'
+JOURNAL_TOTALS = '<4dQ'
+JOURNAL_SPLIT = '<H'
+
+
+'''
+Returns bytes of journal record of given kind for given cell id and packed payload.
+'''
+def encode_record(kind, cell_id = None, payload = b''):
+	record = kind
+	if cell_id != None:
+		id_bytes = cell_id.to_bytes((cell_id.bit_length() + 7) // 8, 'big')
+		record += pack('<B', len(id_bytes)) + id_bytes
+	return record + payload
+
+
+'''
+Reads records of given restart journal one at a time.
+
+\param path Path to journal.
+
+\return Generator yielding ('H', list of root extents) first and then
+('T', totals), ('S', cell id, dimension), ('C', cell id, totals) or ('R', cell id)
+for every record, totals being a list in order of JOURNAL_TOTALS.
+'''
+def read_journal(path):
+	with open(path, 'rb') as journal_file:
+		def read(size):
+			data = journal_file.read(size)
+			if len(data) < size:
+				raise EOFError
+			return data
+
+		def read_id():
+			return int.from_bytes(read(unpack('<B', read(1))[0]), 'big')
+
+		if read(len(JOURNAL_MAGIC)) != JOURNAL_MAGIC:
+			raise ValueError(path + ' is not a restart journal')
+		version, nr_dims = unpack(JOURNAL_HEADER, read(calcsize(JOURNAL_HEADER)))
+		if version != JOURNAL_VERSION:
+			raise ValueError('Unsupported restart journal version ' + str(version))
+		extents = unpack('<' + str(2 * nr_dims) + 'd', read(16 * nr_dims))
+		yield 'H', [(extents[2 * i], extents[2 * i + 1]) for i in range(nr_dims)]
+
+		totals_size = calcsize(JOURNAL_TOTALS)
+		split_size = calcsize(JOURNAL_SPLIT)
+		while True:
+			try:
+				kind = journal_file.read(1)
+				if len(kind) == 0:
+					return
+				if kind == b'T':
+					yield 'T', list(unpack(JOURNAL_TOTALS, read(totals_size)))
+				elif kind == b'S':
+					cell_id = read_id()
+					yield 'S', cell_id, unpack(JOURNAL_SPLIT, read(split_size))[0]
+				elif kind == b'C':
+					cell_id = read_id()
+					yield 'C', cell_id, list(unpack(JOURNAL_TOTALS, read(totals_size)))
+				elif kind == b'R':
+					yield 'R', read_id()
+				else:
+					raise ValueError('Unknown record in restart journal ' + path)
+			except EOFError:
+				return
+
+
+'''
+Returns whether given file is a restart journal instead of a pickled grid of old versions.
+'''
+def is_journal(path):
+	with open(path, 'rb') as restart_file:
+		return restart_file.read(len(JOURNAL_MAGIC)) == JOURNAL_MAGIC
+
+
+'''
+Restart file of rank 0 appended to by a background thread.
+
+\param path Path of restart file.
+\param extents List of minimum and maximum extent of root cell in every dimension.
+\param flush_interval Seconds between flushes of file to disk.
+
+\var totals Sum of what converged cells added to totals, in order of JOURNAL_TOTALS
+\var splits Dictionary of split cell id -> dimension for split cells with descendants left in grid
+\var alive Dictionary of split cell id -> bit mask of its children (bit 0 for id * 2) with descendants left in grid
+\var root_removed Whether root cell has been removed from grid
+
+Rank 0 only queues records, encoding, writing and compaction happen in the
+thread started by start(). Above state describes the grid after records
+written so far and is used for compacting the file into totals of removed
+cells plus splits leading to cells left in grid once it has grown to
+several times that size.
+'''
+class Journal:
+	def __init__(self, path, extents, flush_interval):
+		self.path = path
+		self.extents = extents
+		self.flush_interval = flush_interval
+		self.totals = [0.0, 0.0, 0.0, 0.0, 0]
+		self.splits = {}
+		self.alive = {}
+		self.root_removed = False
+		self.records = Queue()
+		self.journal_file = None
+		self.written = 0
+		self.compacted = 0
+		self.thread = Thread(target = self.run, daemon = True)
+
+	'''
+	Records split of given cell in given dimension.
+	'''
+	def split(self, cell_id, dim):
+		self.records.put(('S', cell_id, dim))
+
+	'''
+	Records that given cell was removed from grid after adding given totals to grid's totals.
+	'''
+	def converge(self, cell_id, totals):
+		self.records.put(('C', cell_id, totals))
+
+	'''
+	Updates state of this journal with given record from read_journal() or queue.
+	'''
+	def apply(self, record):
+		if record[0] == 'T':
+			self.totals = list(record[1])
+		elif record[0] == 'S':
+			self.splits[record[1]] = record[2]
+			self.alive[record[1]] = 3
+		elif record[0] in ('C', 'R'):
+			if record[0] == 'C':
+				for i in range(len(self.totals)):
+					self.totals[i] += record[2][i]
+			# parents without descendants left in grid are forgotten
+			cell_id = record[1]
+			if cell_id == 1:
+				self.root_removed = True
+			while cell_id > 1:
+				parent = cell_id // 2
+				self.alive[parent] &= ~(1 << (cell_id % 2))
+				if self.alive[parent] != 0:
+					break
+				del self.alive[parent]
+				del self.splits[parent]
+				# root without descendants is written as removed by compact()
+				if parent == 1:
+					self.root_removed = True
+				cell_id = parent
+
+	'''
+	Rewrites file with only current state of this journal and opens it for appending.
+	'''
+	def compact(self):
+		if self.journal_file != None:
+			self.journal_file.close()
+		records = 2
+		with open(self.path + '.tmp', 'wb') as journal_file:
+			journal_file.write(JOURNAL_MAGIC + pack(JOURNAL_HEADER, JOURNAL_VERSION, len(self.extents)))
+			for extent in self.extents:
+				journal_file.write(pack('<2d', extent[0], extent[1]))
+			journal_file.write(encode_record(b'T', None, pack(JOURNAL_TOTALS, *self.totals)))
+			# parents before children
+			split_ids = sorted(self.splits)
+			for cell_id in split_ids:
+				journal_file.write(encode_record(b'S', cell_id, pack(JOURNAL_SPLIT, self.splits[cell_id])))
+			records += len(split_ids)
+			for cell_id in split_ids:
+				for i in range(2):
+					child = cell_id * 2 + i
+					if self.alive[cell_id] & (1 << i) == 0 and child not in self.splits:
+						journal_file.write(encode_record(b'R', child))
+						records += 1
+			if self.root_removed:
+				journal_file.write(encode_record(b'R', 1))
+			journal_file.flush()
+			fsync(journal_file.fileno())
+		replace(self.path + '.tmp', self.path)
+		self.journal_file = open(self.path, 'ab')
+		self.compacted = records
+		self.written = 0
+
+	'''
+	Writes queued records until None is queued.
+	'''
+	def run(self):
+		next_flush = time() + self.flush_interval
+		while True:
+			try:
+				record = self.records.get(timeout = max(0, next_flush - time()))
+			except Empty:
+				record = False
+
+			if record == None or time() >= next_flush:
+				self.journal_file.flush()
+				fsync(self.journal_file.fileno())
+				next_flush = time() + self.flush_interval
+			if record == None:
+				self.journal_file.close()
+				return
+			if record == False:
+				continue
 
+			if record[0] == 'S':
+				self.journal_file.write(encode_record(b'S', record[1], pack(JOURNAL_SPLIT, record[2])))
+			else:
+				self.journal_file.write(encode_record(b'C', record[1], pack(JOURNAL_TOTALS, *record[2])))
+			self.apply(record)
+			self.written += 1
+			if self.written > max(10000, 3 * self.compacted):
+				self.compact()
+
+	'''
+	Writes current state of this journal to its file and starts writing queued records in the background.
+	'''
+	def start(self):
+		self.compact()
+		self.thread.start()
+
+	'''
+	Waits until all queued records have been written to disk.
+	'''
+	def close(self):
+		self.records.put(None)
+		self.thread.join()
 
+
+'''
+Rebuilds grid from restart journal.
+
+\param path Path to journal.
+\param flush_interval Seconds between flushes of journal to disk.
+
+\return Tuple with grid and Journal whose state matches grid, not started yet.
 '''
-Used for transferring work between rank 0 and other ranks.
+def load_journal(path, flush_interval):
+	records = read_journal(path)
+	extents = next(records)[1]
+	grid = Cell_Store(len(extents))
+	grid.add(1, extents)
+	journal = Journal(path, extents, flush_interval)
+
+	for record in records:
+		journal.apply(record)
+		if record[0] == 'S':
+			grid.split(record[1], record[2])
+		elif record[0] in ('C', 'R'):
+			grid.remove(record[1])
+
+	for key, total in zip(['converged-volume', 'nan-volume', 'value', 'error', 'nr-cells'], journal.totals):
+		grid.totals[key] = total
+	grid.totals['nr-cells'] = int(grid.totals['nr-cells'])
+	return grid, journal
+
+
+'''
+Returns same info as get_info() from restart journal without building its grid.
+
+Cells left in grid don't contribute to value or error.
+'''
+def get_journal_info(path):
+	total_vol = 1.0
+	totals = [0.0, 0.0, 0.0, 0.0, 0]
+	nr_cells = 1
+	for record in read_journal(path):
+		if record[0] == 'H':
+			for extent in record[1]:
+				total_vol *= extent[1] - extent[0]
+		elif record[0] == 'T':
+			totals = record[1]
+		elif record[0] == 'S':
+			nr_cells += 1
+		elif record[0] == 'C':
+			for i in range(len(totals)):
+				totals[i] += record[2][i]
+			nr_cells -= 1
+		elif record[0] == 'R':
+			nr_cells -= 1
+	return totals[2], totals[3], totals[1], total_vol, int(totals[4]), nr_cells + int(totals[4])
+
+
+
+'''
+Returns Cell_Store with cells and totals of pickled grid written by old versions.
+
+Requires ndgrid submodule and NetworkX for unpickling.
+'''
+def load_pickled_grid(path):
+	with open(path, 'rb') as restartfile:
+		old_grid = load(restartfile)
+	grid = None
+	for old_cell in old_grid.get_cells():
+		old_extents = old_cell.get_extents()
+		if grid == None:
+			grid = Cell_Store(len(old_extents))
+		grid.add(old_cell.data['id'], [old_extents[dim] for dim in sorted(old_extents)])
+		for name in ['converged', 'value', 'error']:
+			grid.set(old_cell.data['id'], name, old_cell.data[name])
+	if grid == None:
+		grid = Cell_Store(0)
+	for key in grid.totals:
+		grid.totals[key] = old_grid.graph.graph[key]
+	return grid
+
+'''
+Used for transferring work between rank 0 and other ranks, in lists of one or more items.
 
 \var volume List of pairs indicating minimum and maximum extent of integration volume in each dimension
 \var cell_id Unique id of a grid cell
 \var converged Whether result of integration converged
 \var value Value of integral
 \var error Estimate of absolute error for calculated integral
-\var split_dim Suggested dimension for splitting the volume in case result didn't converge
+\var calls Number of calls to request from integrand for the volume, None for --calls
+\var first_error Estimate of absolute error after integrating with calls, before checking for convergence
+\var split_dims Dimensions in which to split the volume in case result didn't converge, see choose_split_dims()
+\var halves Value and error of lower and upper half of volume along the only split dimension from integrand, None if not known
+\var idle_time Seconds the worker waited for the list starting with this item after returning its previous list
+\var lost True if integrand was restarted before finishing this item, which should be processed again
+\var restarts Number of times worker restarted its integrand since returning its previous list, set in first item of list
+\var lost_time Seconds integrands spent on requests they didn't finish before being restarted, set with restarts
+\var totals Dictionary like totals of Cell_Store with results of all cells in volume if integrated by a sub-master
 '''
 class Work_Item:
 	def __init__(self):
@@ -89,80 +642,1970 @@ class Work_Item:
 		self.converged = None
 		self.value = None
 		self.error = None
-		self.split_dim = None
+		self.calls = None
+		self.first_error = None
+		self.split_dims = None
+		self.halves = None
+		self.idle_time = None
+		self.lost = False
+		self.restarts = None
+		self.lost_time = None
+		self.totals = None
+
+	def __str__(self):
+		ret_val = 'Id: ' + str(self.cell_id) + ', Vol: '
+		for extent in self.volume:
+			ret_val += '[' + str(extent[0]) + ', ' + str(extent[1]) + '], '
+		return ret_val
+
+	__repr__ = __str__
+
+
+'''
+Sent by a worker instead of results when it splits a cell that didn't converge and continues with one of its children.
+
+\var cell_id Id of split cell
+\var split_dims Dimensions in which cell was split at the middle, in order given to split()
+\var kept Index of child that worker continues with, other children are new work for rank 0
+\var value Value of split cell's integral
+\var error Estimate of absolute error of split cell's integral
+\var first_error Estimate of absolute error of split cell's integral before convergence check
+\var halves Value and error of children's integrals from integrand, None if not known
+'''
+class Split_Notice:
+	def __init__(self):
+		self.cell_id = None
+		self.split_dims = None
+		self.kept = None
+		self.value = None
+		self.error = None
+		self.first_error = None
+		self.halves = None
+
+
+'''
+Used by rank 0 to keep track of worker ranks.
+
+\var in_flight Lists of Work_Items sent to the worker without a result yet, oldest first
+\var send_requests Requests returned by comm.isend() for lists in in_flight
+\var abandoned Freed send requests of lists given to failed worker, kept so that their messages stay alive until sent
+\var processing True if worker is processing items, False if idle, None if failed
+\var start_time When worker started processing oldest list in in_flight
+\var local_calls Calls of cells worker has split itself while processing oldest list in in_flight
+
+Lists after the oldest one in in_flight wait in the worker's queue.
+'''
+class Work_Tracker:
+	def __init__(self):
+		self.in_flight = []
+		self.send_requests = []
+		self.abandoned = []
+		self.processing = None
+		self.start_time = None
+		self.local_calls = 0.0
+
+	'''
+	Records that worker split given cell of its oldest list and continues with given child.
+
+	Child is processed with the calls of cell and replaces it in the list so
+	that it's put back if worker fails.
+	'''
+	def split_locally(self, args, c, kept):
+		for work_item in self.in_flight[0]:
+			if work_item.cell_id == c:
+				work_item.cell_id = kept
+				self.local_calls += get_item_calls(args, work_item)
+
+
+'''
+Used by rank 0 to find cells and work to give without scanning the grid.
+
+\param grid Cell_Store whose cells to add to the queue
+\param prioritize If True give out cells with largest error estimate first, otherwise oldest cells first
+
+\var ready Ids of cells that are neither converged nor processing, may contain stale ids
+\var work_left Number of cells in grid that haven't converged
+\var processing Number of cells in grid being processed
+\var value Sum of value estimates of cells that haven't converged
+\var error Sum of error estimates of cells that haven't converged
+\var unknown Number of cells that haven't converged and don't have an estimate
+\var unknown_volume Total volume of cells counted in unknown
+\var density Value and error per volume of cells without an estimate, None if not known, see scale_estimates()
+\var copies Number of results still expected for cells that were given to more than one worker
+
+State of a cell is kept in grid as before, methods of this class must be
+used for changing it in order to keep above up to date. Cells without an
+estimate are given out before others when prioritizing.
+'''
+class Work_Queue:
+	def __init__(self, grid, prioritize = False):
+		self.grid = grid
+		self.prioritize = prioritize
+		if self.prioritize:
+			self.ready = []
+		else:
+			self.ready = deque()
+		# keeps order of cells with equal priority
+		self.pushed = 0
+		self.work_left = 0
+		self.processing = 0
+		self.value = 0.0
+		self.error = 0.0
+		self.unknown = 0
+		self.unknown_volume = 0.0
+		self.density = None
+		self.copies = {}
+		for c in grid.get_cells():
+			self.add(c)
+
+	'''
+	Adds given cell id to ready cells.
+	'''
+	def push(self, c):
+		if self.prioritize:
+			heappush(self.ready, (-self.get_priority(c), self.pushed, c))
+		else:
+			self.ready.append(c)
+		self.pushed += 1
+
+	'''
+	Returns priority of given cell, error of its estimate or infinity if not known.
+	'''
+	def get_priority(self, c):
+		estimate = self.grid.get(c, 'estimate')
+		if estimate == None or isnan(estimate[1]):
+			return float('inf')
+		return estimate[1]
+
+	'''
+	Removes and returns next id from ready cells, None if it was pushed with an estimate that has since changed.
+	'''
+	def pop(self):
+		if self.prioritize:
+			priority, pushed, c = heappop(self.ready)
+			if c in self.grid and -priority != self.get_priority(c):
+				return None
+			return c
+		else:
+			return self.ready.popleft()
+
+	'''
+	Adds (sign = 1) or subtracts (sign = -1) estimate of given cell from sums.
+	'''
+	def add_estimate(self, c, sign):
+		estimate = self.grid.get(c, 'estimate')
+		if estimate == None:
+			self.unknown += sign
+			self.unknown_volume += sign * self.grid.get_volume(c)
+			# rounding errors don't accumulate
+			if self.unknown == 0:
+				self.unknown_volume = 0.0
+		else:
+			self.value += sign * estimate[0]
+			self.error += sign * estimate[1]
+
+	'''
+	Replaces estimate of given cell that hasn't converged.
+
+	Cell waiting to be processed is pushed again with its new priority,
+	its previous entry is skipped by take().
+	'''
+	def set_estimate(self, c, estimate):
+		self.add_estimate(c, -1)
+		self.grid.set(c, 'estimate', estimate)
+		self.add_estimate(c, 1)
+		if self.prioritize and not self.grid.get(c, 'processing'):
+			self.push(c)
+
+	'''
+	Returns estimate of given cell that hasn't converged, scaled by density if it has none.
+	'''
+	def get_estimate(self, c):
+		estimate = self.grid.get(c, 'estimate')
+		if estimate == None and self.density != None:
+			vol = self.grid.get_volume(c)
+			estimate = (vol * self.density[0], vol * self.density[1])
+		return estimate
+
+	'''
+	Adds given cell of grid to this queue.
+	'''
+	def add(self, c):
+		if self.grid.get(c, 'converged'):
+			return
+		self.work_left += 1
+		self.add_estimate(c, 1)
+		if self.grid.get(c, 'processing'):
+			self.processing += 1
+		else:
+			self.push(c)
+
+	'''
+	Returns next cell to process and marks it as processing, None if there's no such cell.
+	'''
+	def take(self):
+		while len(self.ready) > 0:
+			c = self.pop()
+			if c == None or c not in self.grid or self.grid.get(c, 'converged') or self.grid.get(c, 'processing'):
+				continue
+			self.grid.set(c, 'processing', True)
+			self.processing += 1
+			return c
+		return None
+
+	'''
+	Returns cell being processed back to the queue, e.g. when its worker failed.
+	'''
+	def put_back(self, c):
+		self.grid.set(c, 'processing', False)
+		self.processing -= 1
+		self.push(c)
+
+	'''
+	Removes processed cell from this queue, e.g. before splitting it in grid.
+	'''
+	def remove(self, c):
+		self.grid.set(c, 'processing', False)
+		self.processing -= 1
+		self.work_left -= 1
+		self.add_estimate(c, -1)
+
+	'''
+	Marks processed cell as converged and removes it from this queue.
+	'''
+	def converge(self, c):
+		self.remove(c)
+		self.grid.set(c, 'converged', True)
+
+
+'''
+Splits cell that didn't converge and replaces it with its children in queue.
+
+\param grid Integration grid.
+\param queue Work_Queue of the grid.
+\param c Id of cell to split.
+\param split_dims Dimensions in which to split, giving 2**len(split_dims) children.
+\param value Value of integral in cell.
+\param error Estimate of absolute error of value.
+\param kept Index of child that's still being processed, None if all are new work.
+\param journal Journal in which to record the split, if any.
+\param halves Value and error of every child's integral from integrand, None if not known.
+\param min_value Children that aren't processing and whose absolute value plus error is below this converge without integrating them.
+
+\return Ids of children of cell that are in grid.
+'''
+def split_unconverged(grid, queue, c, split_dims, value, error, kept = None, journal = None, halves = None, min_value = 0.0):
+	queue.remove(c)
+	children = split(c, 1, split_dims, grid, journal)
+	# children inherit their share of unconverged result as estimate,
+	# value of a child isn't known so its error is bounded by parent's value
+	estimate = None
+	if not isnan(value) and not isnan(error):
+		estimate = (value / len(children), (error + abs(value)) / len(children))
+	if halves != None and len(halves) != 2 * len(children):
+		halves = None
+	for i in range(len(children)):
+		child_estimate = estimate
+		if halves != None and not isnan(halves[2 * i]) and not isnan(halves[2 * i + 1]):
+			child_estimate = (halves[2 * i], halves[2 * i + 1])
+			if i != kept and abs(child_estimate[0]) + child_estimate[1] < min_value:
+				converge_cell(grid, children[i], child_estimate[0], child_estimate[1], None, journal)
+				continue
+		grid.set(children[i], 'estimate', child_estimate)
+		grid.set(children[i], 'processing', i == kept)
+		queue.add(children[i])
+	return [child for child in children if child in grid]
+
+
+'''
+Adds result of converged cell to totals of grid and removes the cell.
+
+\param grid Cell_Store of cell.
+\param c Id of cell.
+\param value Value of cell's integral, NaN if integration failed.
+\param error Estimate of absolute error of value.
+\param totals Totals of cells in volume of cell if integrated by a sub-master, None otherwise.
+\param journal Journal in which to record the change, if any.
+'''
+def converge_cell(grid, c, value, error, totals = None, journal = None):
+	if totals == None:
+		totals = {'converged-volume': 0.0, 'nan-volume': 0.0, 'value': 0.0, 'error': 0.0, 'nr-cells': 1}
+		vol = grid.get_volume(c)
+		if isnan(value):
+			totals['nan-volume'] = vol
+		else:
+			totals['converged-volume'] = vol
+			totals['value'] = value
+		if not isnan(error):
+			totals['error'] = error
+	for key in totals:
+		grid.totals[key] += totals[key]
+	if journal != None:
+		journal.converge(c, [totals[key] for key in ['converged-volume', 'nan-volume', 'value', 'error', 'nr-cells']])
+	grid.remove(c)
+
+
+'''
+Estimates cells without an estimate from value and error per volume of converged cells.
+
+\param grid Integration grid.
+\param queue Work_Queue of the grid.
+
+Sets density of queue, which Work_Queue.get_estimate() multiplies by
+volume of a cell, so the estimates of all such cells are updated without
+visiting them. As for children of split cells the error of a cell whose
+value isn't known is bounded by its value. Used for subtrees given to
+sub-masters, which return only a converged result, so that target error
+can be checked before every subtree has been integrated.
+'''
+def scale_estimates(grid, queue):
+	converged_vol = grid.totals['converged-volume']
+	if converged_vol <= 0:
+		return
+	queue.density = (
+		grid.totals['value'] / converged_vol,
+		(grid.totals['error'] + abs(grid.totals['value'])) / converged_vol
+	)
+
+
+'''
+Returns cells queued for a failed worker back to the queue of rank 0.
+
+\param work_tracker Work_Tracker of the failed worker
+\param queue Work_Queue of the grid.
+\param start Index of first list in work_tracker.in_flight to return
+'''
+def put_back_queued(work_tracker, queue, start):
+	for work_items in work_tracker.in_flight[start:]:
+		for work_item in work_items:
+			c = work_item.cell_id
+			# another worker has a copy of the cell
+			if c in queue.copies:
+				queue.copies[c] -= 1
+				if queue.copies[c] == 0:
+					del queue.copies[c]
+				continue
+			if c in queue.grid and queue.grid.get(c, 'processing'):
+				queue.put_back(c)
+	work_tracker.in_flight = work_tracker.in_flight[:start]
+
+
+'''
+Stops communicating with failed worker.
+
+\param work_tracker Work_Tracker of the worker, whose cells have been put back already if needed.
+\param request Receive posted for the worker, None if there isn't one.
+
+Cancels the receive and frees sends still pending, so that a result or
+message that arrives later doesn't complete them and MPI doesn't keep
+them until the end. Lists of the worker are forgotten.
+'''
+def abandon_worker(work_tracker, request):
+	work_tracker.processing = None
+	if request != None:
+		request.Cancel()
+		request.Wait()
+	for send_request in work_tracker.send_requests:
+		if not send_request.Test():
+			send_request.Free()
+			work_tracker.abandoned.append(send_request)
+	work_tracker.send_requests = []
+	work_tracker.in_flight = []
+
+
+'''
+Recent seconds per call that workers spent processing lists of cells.
+
+\param size Number of most recent times to keep.
+
+Times are per call so that cells given different numbers of calls, e.g.
+with --allocation error, are comparable.
+'''
+class Call_Times:
+	def __init__(self, size = 1000):
+		self.times = deque(maxlen = size)
+		self.sorted = None
+
+	def add(self, seconds):
+		self.times.append(seconds)
+		self.sorted = None
+
+	'''
+	Returns given quantile (0..1) of kept times, None if fewer than min_times are kept.
+	'''
+	def quantile(self, q, min_times = 1):
+		if len(self.times) < max(1, min_times):
+			return None
+		if self.sorted == None:
+			self.sorted = sorted(self.times)
+		return self.sorted[min(len(self.sorted) - 1, int(q * len(self.sorted)))]
+
+
+'''
+Running model of integration error against number of calls, used by rank 0 for giving cells different numbers of calls.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+
+\var regions Dictionary of region id -> [exponent, log of error per volume] from results of cells in region
+\var reference Moving average of log of error coefficient of results, None if there are no results yet
+\var coefficients Dictionary of cell id -> error coefficient estimated from parent's result
+\var given Dictionary of cell id -> calls given to cell being processed
+\var total Number of calls requested from integrands so far, including convergence checks
+
+Error of a cell integrated with n calls is modeled as k * n**-a, where the
+exponent a is measured from the error before and after the convergence
+check. Coefficient k of a child is parent's coefficient times child's volume
+fraction, or if the cell has no parent in the model error per volume of its
+region times its volume. Region of a cell is its ancestor REGION_BITS bits up
+the tree of cell ids, every result also updates regions of further ancestors
+which are used until a region has results of its own. A cell gets
+--calls * (k / K)**(1 / (1 + a)) calls, K being the typical coefficient of
+results so far, between --min-calls and --max-calls, which minimizes sum of
+errors for given total number of calls.
+'''
+class Call_Allocator:
+	REGION_BITS = 4
+
+	def __init__(self, args):
+		self.args = args
+		self.regions = {}
+		self.reference = None
+		self.coefficients = {}
+		self.given = {}
+		self.total = 0.0
+
+	'''
+	Returns ids of regions of given cell, smallest region first.
+	'''
+	def get_regions(self, c):
+		regions = []
+		while c > 0:
+			c >>= self.REGION_BITS
+			regions.append(c)
+		return regions
+
+	'''
+	Returns [exponent, log of error per volume] of smallest region of given cell with results, None if there are no results.
+	'''
+	def get_model(self, c):
+		for region in self.get_regions(c):
+			if region in self.regions:
+				return self.regions[region]
+		return None
+
+	'''
+	Returns number of calls to give to given cell of given grid.
+	'''
+	def get_calls(self, grid, c):
+		calls = self.args.calls
+		model = self.get_model(c)
+		if model != None and self.reference != None:
+			coefficient = self.coefficients.get(c)
+			if coefficient == None:
+				coefficient = exp(model[1]) * grid.get_volume(c)
+			if coefficient > 0:
+				calls *= (coefficient / exp(self.reference))**(1 / (1 + model[0]))
+		calls = float(int(min(self.args.max_calls, max(self.args.min_calls, calls))))
+		self.given[c] = calls
+		return calls
+
+	'''
+	Updates model with result of given cell integrated with calls it was given.
+
+	\param c Id of cell.
+	\param first_error Estimate of absolute error before convergence check, None if not known.
+	\param error Estimate of absolute error after convergence check.
+	\param volume Volume of cell.
+
+	\return Error coefficient of cell, None if not known.
+	'''
+	def add_result(self, c, first_error, error, volume):
+		calls = self.given.get(c, self.args.calls)
+		factor = self.args.calls_factor
+		final_calls = calls * factor
+		self.total += final_calls
+		if not continues_samples(self.args):
+			self.total += calls
+
+		if error == None or isnan(error) or error <= 0 or volume <= 0:
+			return None
+		exponent = None
+		if factor > 1 and first_error != None and not isnan(first_error) and first_error > 0:
+			exponent = min(1.0, max(0.25, log(first_error / error) / log(factor)))
+
+		for region in self.get_regions(c):
+			model = self.regions.get(region)
+			if model == None:
+				model = self.regions[region] = [0.5, None]
+			if exponent != None:
+				model[0] = 0.8 * model[0] + 0.2 * exponent
+			density = log(error / volume) + model[0] * log(final_calls)
+			if model[1] == None:
+				model[1] = density
+			else:
+				model[1] = 0.8 * model[1] + 0.2 * density
+
+		coefficient = log(error) + self.get_model(c)[0] * log(final_calls)
+		if self.reference == None:
+			self.reference = coefficient
+		else:
+			self.reference = 0.8 * self.reference + 0.2 * coefficient
+		return exp(coefficient)
+
+	'''
+	Forgets given cell that was split and gives its children their share of its error coefficient.
+
+	\param c Id of split cell.
+	\param coefficient Error coefficient of split cell, None if not known.
+	\param children Ids of children in grid.
+	\param nr_children Number of children cell was split into.
+	\param kept Id of child that's still being processed with calls given to split cell, None if there's no such child.
+	'''
+	def split(self, c, coefficient, children, nr_children, kept = None):
+		calls = self.given.pop(c, None)
+		self.coefficients.pop(c, None)
+		if kept != None and calls != None:
+			self.given[kept] = calls
+		if coefficient == None:
+			return
+		for child in children:
+			self.coefficients[child] = coefficient / nr_children
+
+	'''
+	Forgets given cell that converged.
+	'''
+	def remove(self, c):
+		self.given.pop(c, None)
+		self.coefficients.pop(c, None)
+
+
+'''
+Returns number of calls given to work item, --calls if it wasn't given any.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+'''
+def get_item_calls(args, work_item):
+	if work_item.calls == None:
+		return args.calls
+	return work_item.calls
+
+
+'''
+Returns total number of calls given to list of work items.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+'''
+def get_list_calls(args, work_items):
+	return sum(get_item_calls(args, work_item) for work_item in work_items)
+
+
+'''
+Returns seconds per call after which a worker is considered failed, no time limit if <= 0.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param call_times Call_Times of workers.
+
+Limit is --timer per --calls calls, or --adaptive-timeout times 95th
+percentile of recent times per call if that's smaller and enough times
+are known.
+'''
+def get_call_timeout(args, call_times):
+	if args.timer <= 0:
+		return args.timer
+	timeout = args.timer / max(1.0, args.calls)
+	typical = call_times.quantile(0.95, 20)
+	if args.adaptive_timeout <= 0 or typical == None:
+		return timeout
+	return min(timeout, args.adaptive_timeout * typical)
+
+
+'''
+Returns seconds a worker should take for the oldest list of cells it's processing.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param work_tracker Work_Tracker of the worker.
+\param per_call Seconds per call.
+
+Cells worker has split itself count with the calls of their parent.
+'''
+def get_expected_time(args, work_tracker, per_call):
+	return per_call * (get_list_calls(args, work_tracker.in_flight[0]) + work_tracker.local_calls)
+
+
+'''
+Returns id of cell that's being processed much longer than cells usually take, None if there's no such cell.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param queue Work_Queue of the grid.
+\param work_trackers Work_Trackers of all workers.
+\param call_times Call_Times of workers.
+
+Worker whose oldest list has taken longest compared to --speculate times
+the median time per call of its cells is chosen, and from its list a cell that isn't
+being processed by another worker already. Cells aren't copied if
+workers refine cells themselves, which would split the same cell twice.
+'''
+def find_straggler(args, queue, work_trackers, call_times):
+	if args.speculate <= 0 or args.local_refine > 0:
+		return None
+	typical = call_times.quantile(0.5, 10)
+	if typical == None:
+		return None
+	now = datetime.now()
+	straggler = None
+	max_ratio = 1.0
+	for work_tracker in work_trackers:
+		if len(work_tracker.in_flight) == 0 or work_tracker.start_time == None:
+			continue
+		elapsed = (now - work_tracker.start_time).total_seconds()
+		ratio = elapsed / max(1e-6, args.speculate * get_expected_time(args, work_tracker, typical))
+		if ratio <= max_ratio:
+			continue
+		for work_item in work_tracker.in_flight[0]:
+			c = work_item.cell_id
+			if c in queue.grid and queue.grid.get(c, 'processing') and c not in queue.copies:
+				straggler = c
+				max_ratio = ratio
+				break
+	return straggler
+
+
+'''
+Returns maximum number of cells and of their calls to send to a worker in one message.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param queue Work_Queue of the grid.
+\param time_per_call Average number of seconds workers have spent per call, None if not known yet
+\param workers Number of queue slots in workers that haven't failed
+
+\return Tuple of number of cells and number of calls, None if calls aren't limited.
+
+Calls of batch take about --batch-time seconds to process but batch isn't
+larger than --max-batch or than this worker's share of cells ready to be
+processed. First cell is sent even if it has more calls.
+'''
+def get_batch_size(args, queue, time_per_call, workers):
+	if args.max_batch <= 1 or time_per_call == None:
+		return 1, None
+	batch_calls = None
+	if time_per_call > 0:
+		batch_calls = args.batch_time / time_per_call
+	ready = queue.work_left - queue.processing
+	batch_size = min(args.max_batch, ready // max(1, workers))
+	return max(1, batch_size), batch_calls
+
+
+'''
+Returns whether estimated error of whole integral is below target given on command line.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param grid Integration grid.
+\param queue Work_Queue of the grid.
+
+Error of the integral is the error of converged cells plus error estimates
+of other cells, target can't be reached while some cell has no estimate
+and density of queue isn't known.
+'''
+def target_reached(args, grid, queue):
+	if args.target_error <= 0 and args.target_relative_error <= 0:
+		return False
+	value = grid.totals['value'] + queue.value
+	error = grid.totals['error'] + queue.error
+	if queue.unknown > 0:
+		if queue.density == None:
+			return False
+		value += queue.unknown_volume * queue.density[0]
+		error += queue.unknown_volume * queue.density[1]
+	if args.target_error > 0 and error <= args.target_error:
+		return True
+	if args.target_relative_error > 0 and error <= args.target_relative_error * abs(value):
+		return True
+	return False
+
+
+'''
+Returns basic info about the calculated solution.
+
+\param grid Integration grid.
+
+\return Tuple with current integral's value, error, NaN volume, total volume, number of converged cells and total number of grid cells.
+'''
+def get_info(grid):
+	converged_cells = grid.totals['nr-cells']
+	# sum up final result
+	nan_vol = grid.totals['nan-volume']
+	total_vol = nan_vol + grid.totals['converged-volume']
+	value = grid.totals['value']
+	error = grid.totals['error']
+
+	cells = grid.get_cells()
+	for c in cells:
+		if grid.get(c, 'converged'):
+			converged_cells += 1
+
+		vol = grid.get_volume(c)
+		total_vol += vol
+
+		c_value = grid.get(c, 'value')
+		if c_value != None:
+			if isnan(c_value):
+				nan_vol += vol
+			else:
+				value += c_value
+
+		c_error = grid.get(c, 'error')
+		if c_error != None and not isnan(c_error):
+			error += c_error
+
+	return value, error, nan_vol, total_vol, converged_cells, len(cells) + grid.totals['nr-cells']
+
+
+# tag of messages rank sends to itself when a deadline passes, others use 1
+WAKE_UP_TAG = 2
+
+
+'''
+Thread that sends a message to its own rank when a deadline passes.
+
+\param comm MPI communicator whose rank to wake up.
+
+\var request Posted receive of the next wake-up message.
+
+MPI can't wait for requests with a timeout, so wait_for_results()
+blocks in Waitsome also on request, which completes once the deadline
+given to set() passes. A wake-up sent just before the deadline is
+changed arrives later and only makes a wait return early. Requires
+MPI_THREAD_MULTIPLE, see create().
+'''
+class Wake_Up:
+	def __init__(self, comm):
+		self.comm = comm
+		self.rank = comm.Get_rank()
+		self.request = comm.irecv(source = self.rank, tag = WAKE_UP_TAG)
+		self.deadline = None
+		self.stop = False
+		self.condition = Condition()
+		self.thread = Thread(target = self.run, daemon = True)
+		self.thread.start()
+
+	'''
+	Returns Wake_Up for given communicator, None if MPI doesn't support calls from several threads.
+	'''
+	@staticmethod
+	def create(comm):
+		if MPI.Query_thread() != MPI.THREAD_MULTIPLE:
+			return None
+		return Wake_Up(comm)
+
+	'''
+	Sends wake-up at given datetime, none if None.
+	'''
+	def set(self, deadline):
+		with self.condition:
+			self.deadline = deadline
+			self.condition.notify()
+
+	'''
+	Posts receive of next wake-up after request completed.
+	'''
+	def rearm(self):
+		self.request = self.comm.irecv(source = self.rank, tag = WAKE_UP_TAG)
+
+	def run(self):
+		with self.condition:
+			while not self.stop:
+				if self.deadline == None:
+					self.condition.wait()
+					continue
+				remaining = (self.deadline - datetime.now()).total_seconds()
+				if remaining > 0:
+					self.condition.wait(remaining)
+					continue
+				self.deadline = None
+				self.comm.send(None, dest = self.rank, tag = WAKE_UP_TAG)
+
+	'''
+	Stops thread and cancels posted receive.
+	'''
+	def close(self):
+		with self.condition:
+			self.stop = True
+			self.condition.notify()
+		self.thread.join()
+		self.request.Cancel()
+		self.request.Wait()
+
+
+'''
+Waits until at least one posted receive completes or deadline passes.
+
+\param requests List of requests returned by comm.irecv(), None for ranks without a posted receive
+\param deadline Return at this datetime even if no receive completed, None to wait indefinitely
+\param wake_up Wake_Up of this rank, None if not available
+\param max_sleep Maximum time in seconds to sleep between tests of requests without wake_up
+
+\return Tuple with list of indices of completed requests and list of corresponding received objects.
+
+Blocks in Waitsome, with a deadline also on wake_up's request so that
+results are handled as soon as they arrive. If MPI doesn't support
+wake_up tests requests with exponentially increasing sleeps in between,
+at most max_sleep or until deadline.
+'''
+def wait_for_results(requests, deadline, wake_up = None, max_sleep = 1e-3):
+	indices = [i for i in range(len(requests)) if requests[i] != None]
+	if len(indices) == 0:
+		return [], []
+	active = [requests[i] for i in indices]
+
+	if deadline == None:
+		ready, results = MPI.Request.waitsome(active)
+		return [indices[i] for i in ready], results
+
+	if wake_up != None:
+		wake_up.set(deadline)
+		ready, results = MPI.Request.waitsome(active + [wake_up.request])
+		wake_up.set(None)
+		completed = []
+		received = []
+		for i, result in zip(ready, results):
+			if i == len(active):
+				wake_up.rearm()
+			else:
+				completed.append(indices[i])
+				received.append(result)
+		return completed, received
+
+	sleep_time = 1e-6
+	while True:
+		ready, results = MPI.Request.testsome(active)
+		if ready != None and len(ready) > 0:
+			return [indices[i] for i in ready], results
+		remaining = (deadline - datetime.now()).total_seconds()
+		if remaining <= 0:
+			return [], []
+		sleep(min(sleep_time, max_sleep, remaining))
+		sleep_time *= 2
+
+
+'''
+Timeline of events of one rank written to a CSV file with --trace.
+
+\param path Path of file, existing file is overwritten.
+\param interval Minimum seconds between recorded snapshots of work queue.
+
+Every line is start,end,track,event,cell,info with times in seconds since
+epoch, end being empty for instantaneous events and cell empty for
+events not concerning a cell. Track names the part of the rank, e.g.
+master or worker, that the event belongs to. C++ integrands append the
+same kind of lines to their own file, see Trace in
+integrands/protocol.hpp. Lines are buffered and written when the buffer
+fills up and by close(). Files are converted to Chrome trace format with
+--convert-trace, see convert_trace().
+'''
+class Trace:
+	def __init__(self, path, interval):
+		self.trace_file = open(path, 'w', buffering = 2**20)
+		self.interval = interval
+		self.next_snapshot = 0.0
+
+	'''
+	Records that event took place on given track from start to end, or at start if end is None.
+	'''
+	def add(self, track, event, start, end = None, cell = None, info = ''):
+		self.trace_file.write('{:.6f},{},{},{},{},{}\n'.format(
+			start,
+			'' if end == None else '{:.6f}'.format(end),
+			track,
+			event,
+			'' if cell == None else cell,
+			info
+		))
+
+	'''
+	Records given counters of work queue as event queue if interval has passed since previous snapshot.
+
+	\param counters List of (name, value) pairs.
+	'''
+	def snapshot(self, track, counters):
+		now = time()
+		if now < self.next_snapshot:
+			return
+		self.next_snapshot = now + self.interval
+		self.add(track, 'queue', now, info = ' '.join(name + '=' + str(value) for name, value in counters))
+
+	def close(self):
+		self.trace_file.close()
+
+
+'''
+Trace of this rank, None without --trace.
+'''
+trace = None
+
+
+'''
+Returns path of trace file with given prefix of given rank, of its integrand if integrand is True.
+'''
+def get_trace_path(prefix, rank, integrand = False):
+	if integrand:
+		return prefix + '.' + str(rank) + '.integrand.csv'
+	return prefix + '.' + str(rank) + '.csv'
+
+
+'''
+Converts trace files written with --trace to Chrome trace format viewable with Perfetto or chrome://tracing.
+
+\param prefix Prefix given to --trace, files are read from prefix.*.csv and result is written to prefix.json.
+
+\return Number of converted events.
+
+Every rank is a process and every track a thread, time starts from first
+event. Time from dispatching a cell to receiving its result is shown as
+an async event with id of cell, snapshots of work queue as counters.
+'''
+def convert_trace(prefix):
+	rows = []
+	for path in glob(prefix + '.*.csv'):
+		rank = basename(path)[len(basename(prefix)) + 1:].split('.')[0]
+		if not rank.isdigit():
+			continue
+		with open(path) as trace_file:
+			for line in trace_file:
+				fields = line.rstrip('\n').split(',', 5)
+				if len(fields) < 6:
+					continue
+				rows.append((int(rank), fields))
+
+	events = []
+	if len(rows) == 0:
+		begin = 0.0
+	else:
+		begin = min(float(fields[0]) for rank, fields in rows)
+	for rank, (start, end, track, event, cell, info) in rows:
+		ts = (float(start) - begin) * 1e6
+		common = {'pid': rank, 'tid': track, 'ts': ts}
+		args = {}
+		if cell != '':
+			args['cell'] = int(cell)
+		if info != '':
+			args['info'] = info
+
+		if event == 'queue':
+			counters = {}
+			for counter in info.split():
+				name, value = counter.split('=')
+				counters[name] = float(value)
+			events.append(dict(common, name = 'queue', ph = 'C', args = counters))
+		elif event in ('dispatch', 'receive') and cell != '':
+			events.append(dict(common, name = 'cell', cat = 'cell', id = cell, ph = 'b' if event == 'dispatch' else 'e', args = args))
+			events.append(dict(common, name = event, ph = 'i', s = 't', args = args))
+		elif end == '':
+			events.append(dict(common, name = event, ph = 'i', s = 't', args = args))
+		else:
+			events.append(dict(common, name = event, ph = 'X', dur = (float(end) - float(start)) * 1e6, args = args))
+
+	# names of processes
+	for rank in sorted(set(rank for rank, fields in rows)):
+		events.append({'pid': rank, 'ph': 'M', 'name': 'process_name', 'args': {'name': 'rank ' + str(rank)}})
+
+	with open(prefix + '.json', 'w') as out_file:
+		json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, out_file)
+	return len(events)
+
+
+'''
+First line sent to integrand for switching to binary protocol, see integrands/protocol.hpp.
+'''
+BINARY_HELLO = b'hdintegrator binary 1'
+
+'''
+Seconds to wait for integrand to repeat BINARY_HELLO or HOST_HELLO if --integrand-timeout isn't given.
+'''
+BINARY_HELLO_TIMEOUT = 30
+
+'''
+First line sent to integrand host, followed by " continue" if continues_samples(), see integrands/host.cpp.
+'''
+HOST_HELLO = b'hdintegrator host 1'
+
+
+'''
+Returns whether convergence check continues integrations of first results, see process().
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+'''
+def continues_samples(args):
+	return args.continue_samples and args.calls_factor > 1
+
+
+'''
+Integrand loaded into worker from a shared object, see integrands/plugin.h.
+
+Volumes are integrated by calling the integrand directly instead of
+communicating with a separate process.
+
+\var library Value returned by ctypes.CDLL for shared object.
+\var handle Value returned by hdintegrator_init() of integrand.
+'''
+class Plugin_Integrand:
+	def __init__(self, args):
+		self.library = CDLL(abspath(args.integrand))
+		self.library.hdintegrator_init.restype = c_void_p
+		self.library.hdintegrator_init.argtypes = [c_int, POINTER(c_char_p)]
+		self.library.hdintegrator_integrate.restype = c_int
+		self.library.hdintegrator_integrate.argtypes = [
+			c_void_p, c_size_t, POINTER(c_double), POINTER(c_double), c_double, c_int,
+			POINTER(c_double), POINTER(c_double), POINTER(c_int), POINTER(c_double), POINTER(c_double)
+		]
+		self.library.hdintegrator_teardown.restype = None
+		self.library.hdintegrator_teardown.argtypes = [c_void_p]
+
+		arg_list = [args.integrand]
+		if args.args != None:
+			arg_list += shlex.split(args.args)
+		argv = (c_char_p * (len(arg_list) + 1))(*[arg.encode() for arg in arg_list], None)
+		self.handle = self.library.hdintegrator_init(len(arg_list), argv)
+		if not self.handle:
+			raise RuntimeError('Initialization of integrand ' + args.integrand + ' failed')
+
+		self.value, self.error, self.split_dim = c_double(), c_double(), c_int()
+		self.halves = (c_double * 4)()
+
+	'''
+	Returns tuple of value, error, split dimension, halves and scores of given work item, see read_answer().
+
+	\param continued If True calls are added to those of previous integration of same volume.
+	'''
+	def integrate(self, work_item, calls, continued):
+		mins = (c_double * len(work_item.volume))(*[extent[0] for extent in work_item.volume])
+		maxs = (c_double * len(work_item.volume))(*[extent[1] for extent in work_item.volume])
+		scores = (c_double * len(work_item.volume))()
+		ret_val = self.library.hdintegrator_integrate(
+			self.handle, len(work_item.volume), mins, maxs, calls, int(continued),
+			byref(self.value), byref(self.error), byref(self.split_dim), self.halves, scores
+		)
+		if ret_val != 0:
+			raise RuntimeError('integrand returned ' + str(ret_val))
+		halves = tuple(self.halves)
+		if any(isnan(half) for half in halves):
+			halves = None
+		return self.value.value, self.error.value, self.split_dim.value, halves, tuple(scores)
+
+	def close(self):
+		if self.handle:
+			self.library.hdintegrator_teardown(self.handle)
+			self.handle = None
+
+
+'''
+Connection to integrand host shared by workers through a unix socket, see integrands/host.cpp.
+
+Has the attributes of Popen used with integrand programs, input and
+output of integrand being the same socket.
+'''
+class Host_Connection:
+	def __init__(self, path):
+		self.stdin = socket(AF_UNIX, SOCK_STREAM)
+		self.stdin.connect(path)
+		self.stdout = self.stdin
+
+	def kill(self):
+		self.stdin.close()
+
+	def wait(self, timeout = None):
+		pass
+
+
+'''
+Prepares an integrand with Popen.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+
+\return Value returned by Popen, with binary attribute telling whether integrand uses binary protocol,
+Plugin_Integrand if integrand is a shared object (.so) or Host_Connection with --integrand-host.
+
+If binary protocol was requested but integrand doesn't repeat BINARY_HELLO
+within --integrand-timeout seconds, or BINARY_HELLO_TIMEOUT without one,
+it's restarted and text protocol is used from then on. Environment
+variable HDINTEGRATOR_CONTINUE is set if continues_samples() so that
+integrands keep samples of volumes only when they'll be continued. Host
+started separately doesn't see the variable so it's told with HOST_HELLO
+instead, and all ranks are aborted if host doesn't repeat it, e.g.
+because its integrand can't continue samples of several workers.
+'''
+def prepare_integrand(args):
+	if continues_samples(args):
+		environ['HDINTEGRATOR_CONTINUE'] = '1'
+	if args.integrand_host != '':
+		try:
+			integrand = Host_Connection(args.integrand_host)
+		except Exception as e:
+			print('Rank', rank, "couldn't connect to integrand host:", e)
+			stdout.flush()
+			# other ranks would wait for this one forever
+			comm.Abort(1)
+	elif args.integrand.endswith('.so'):
+		try:
+			integrand = Plugin_Integrand(args)
+		except Exception as e:
+			print('Rank', rank, "couldn't load integrand:", e)
+			stdout.flush()
+			exit(1)
+		if args.verbose:
+			print('Integrand loaded by rank', rank)
+			stdout.flush()
+		return integrand
+	else:
+		arg_list = [args.integrand]
+		if args.args != None:
+			arg_list += shlex.split(args.args)
+		env = None
+		if args.trace != '':
+			env = dict(environ, HDINTEGRATOR_TRACE = get_trace_path(args.trace, rank, True))
+		# unbuffered so that select() sees everything integrand wrote
+		integrand = Popen(arg_list, stdin = PIPE, stdout = PIPE, bufsize = 0, env = env)
+	integrand.binary = False
+	integrand.buffer = bytearray()
+	set_blocking(integrand.stdin.fileno(), False)
+
+	if args.integrand_host != '':
+		hello = HOST_HELLO
+		if continues_samples(args):
+			hello += b' continue'
+		reply = None
+		deadline = get_deadline(args)
+		if deadline == None:
+			deadline = time() + BINARY_HELLO_TIMEOUT
+		try:
+			if write_integrand(integrand, hello + b'\n', deadline - time()):
+				reply = read_integrand(integrand, None, deadline)
+		except Exception:
+			pass
+		if reply == None or reply.strip() != hello:
+			print(
+				'Rank', rank, 'integrand host refused connection:',
+				'no reply' if reply == None else reply.decode(errors = 'replace').strip()
+			)
+			stdout.flush()
+			comm.Abort(1)
+
+	if args.protocol == 'binary':
+		reply = None
+		# text integrands might wait for the rest of a request that never comes
+		deadline = get_deadline(args)
+		if deadline == None:
+			deadline = time() + BINARY_HELLO_TIMEOUT
+		try:
+			if write_integrand(integrand, BINARY_HELLO + b'\n', deadline - time()):
+				reply = read_integrand(integrand, None, deadline)
+		except Exception:
+			pass
+		if reply == None or reply.strip() != BINARY_HELLO:
+			print('Rank', rank, "integrand doesn't support binary protocol, using text")
+			stdout.flush()
+			integrand.kill()
+			integrand.wait()
+			args.protocol = 'text'
+			return prepare_integrand(args)
+		integrand.binary = True
+
+	if args.verbose:
+		print('Integrand initialized by rank', rank)
+	stdout.flush()
+	return integrand
+
+
+'''
+Returns request to integrand in its protocol, None if volume is invalid.
+
+\param integrand Integrand returned by prepare_integrand()
+\param work_item Work_Item whose volume to integrate
+\param calls Number of calls to request from integrand
+\param continued If True integrand adds calls to those of its previous integration of volume
+'''
+def format_request(integrand, work_item, calls, continued):
+	if integrand.binary:
+		extents = []
+		for extent in work_item.volume:
+			if extent[0] >= extent[1]:
+				return None
+			extents += extent
+		payload = pack('=II' + str(1 + len(extents)) + 'd', int(continued), len(work_item.volume), calls, *extents)
+		return pack('=I', len(payload)) + payload
+
+	# + in front of calls tells integrand to continue
+	if continued:
+		to_stdin = '{:+.16e} '.format(calls)
+	else:
+		to_stdin = '{:.16e} '.format(calls)
+	for extent in work_item.volume:
+		ext_str = '{:.16e} {:.16e} '.format(extent[0], extent[1])
+		first, second = ext_str.split()
+		if first == second or float(first) >= float(second):
+			return None
+		to_stdin += ext_str
+	return (to_stdin + '\n').encode()
+
+
+'''
+Returns seconds after which integrand is considered stuck, None if there's no time limit.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+'''
+def get_timeout(args):
+	if args.integrand_timeout <= 0:
+		return None
+	return args.integrand_timeout
+
+
+'''
+Returns time() after which integrand is considered stuck, None if there's no time limit.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+'''
+def get_deadline(args):
+	timeout = get_timeout(args)
+	if timeout == None:
+		return None
+	return time() + timeout
+
+
+'''
+Reads given number of bytes or one line from output of integrand.
+
+\param integrand Integrand returned by prepare_integrand()
+\param size Number of bytes to read, None to read until and including newline
+\param deadline time() after which to stop waiting for integrand, None to wait forever
+
+\return Bytes read, None if deadline passed or integrand closed its output first.
+'''
+def read_integrand(integrand, size, deadline):
+	while True:
+		if size == None:
+			end = integrand.buffer.find(b'\n') + 1
+		elif len(integrand.buffer) >= size:
+			end = size
+		else:
+			end = 0
+		if end > 0:
+			data = bytes(integrand.buffer[:end])
+			del integrand.buffer[:end]
+			return data
+
+		timeout = None
+		if deadline != None:
+			timeout = deadline - time()
+			if timeout <= 0:
+				return None
+		ready, _, _ = select([integrand.stdout], [], [], timeout)
+		if len(ready) == 0:
+			return None
+		data = read(integrand.stdout.fileno(), 2**16)
+		if len(data) == 0:
+			return None
+		integrand.buffer += data
+
+
+'''
+Writes given bytes to input of integrand while reading its output.
+
+\param integrand Integrand returned by prepare_integrand()
+\param data Bytes to write
+\param timeout Seconds to wait for integrand to read input or write output, None to wait forever
+
+\return True if all bytes were written, False if integrand closed its output
+or made no progress within timeout first.
+
+Output is added to integrand.buffer for read_integrand() so that an
+integrand answering earlier requests never blocks on a full pipe while
+later requests are still being written. Input of integrand must be
+nonblocking.
+'''
+def write_integrand(integrand, data, timeout):
+	data = memoryview(data)
+	while len(data) > 0:
+		readable, writable, _ = select([integrand.stdout], [integrand.stdin], [], timeout)
+		if len(readable) == 0 and len(writable) == 0:
+			return False
+		if len(readable) > 0:
+			output = read(integrand.stdout.fileno(), 2**16)
+			if len(output) == 0:
+				return False
+			integrand.buffer += output
+		if len(writable) > 0:
+			try:
+				data = data[write(integrand.stdin.fileno(), data):]
+			except BlockingIOError:
+				pass
+	return True
+
+
+'''
+Reads answer to one request from integrand.
+
+\param deadline time() after which to stop waiting for integrand, None to wait forever
+
+\return Tuple of value, error, split dimension, halves, which are value and error of
+lower and upper half of volume along split dimension, and scores of splitting volume
+along every dimension. Halves and scores are None if integrand didn't give them.
+
+Raises RuntimeError if integrand didn't answer before deadline.
+'''
+def read_answer(integrand, deadline):
+	if integrand.binary:
+		header = read_integrand(integrand, 4, deadline)
+		if header == None:
+			raise RuntimeError('no answer from integrand')
+		size = unpack('=I', header)[0]
+		answer = read_integrand(integrand, size, deadline)
+		if answer == None:
+			raise RuntimeError('incomplete answer from integrand')
+		halves, scores = None, None
+		if size >= 52:
+			halves = unpack('=4d', answer[20:52])
+		if size > 52:
+			scores = unpack('=' + str((size - 52) // 8) + 'd', answer[52:])
+		return unpack('=ddi', answer[:20]) + (halves, scores)
+
+	answer = read_integrand(integrand, None, deadline)
+	if answer == None:
+		raise RuntimeError('no answer from integrand')
+	answer = answer.decode().strip().split()
+	halves, scores = None, None
+	if len(answer) >= 7:
+		halves = tuple(float(half) for half in answer[3:7])
+	if len(answer) > 7:
+		scores = tuple(float(score) for score in answer[7:])
+	return float(answer[0]), float(answer[1]), int(answer[2]), halves, scores
+
+
+'''
+Restarts of integrands in this process and seconds they spent on requests they didn't finish.
+
+consecutive is the number of restarts since integrand last answered.
+'''
+integrand_stats = {'restarts': 0, 'lost-time': 0.0, 'consecutive': 0}
+
+
+'''
+Kills given integrand and returns a new one from prepare_integrand().
+
+\param lost_time Seconds integrand spent on requests it didn't finish.
+
+Waits before starting new integrand 0.1 s times two to the power of
+number of restarts since integrand last answered, at most 10 s.
+'''
+def restart_integrand(integrand, args, lost_time):
+	try:
+		integrand.kill()
+		integrand.wait()
+	except Exception:
+		pass
+	integrand_stats['restarts'] += 1
+	integrand_stats['lost-time'] += lost_time
+	sleep(min(10.0, 0.1 * 2**integrand_stats['consecutive']))
+	integrand_stats['consecutive'] += 1
+	if trace != None:
+		trace.add('worker', 'restart', time())
+	print('Rank', rank, 'restarted integrand')
+	stdout.flush()
+	return prepare_integrand(args)
+
+
+'''
+Integrates volumes of given work items with integrand.
+
+\param integrand Integrand returned by prepare_integrand()
+\param work_items List of Work_Items whose volumes to integrate
+\param calls List with number of calls to request from integrand for every volume
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param continued If True integrand adds calls to those of its previous integration of each volume
+
+\return Tuple with list of (value, error, split dimension, halves, scores) from integrand for every work item,
+None for items that failed, and integrand to use for subsequent integrations.
+
+All requests are written to integrand together, answers it gives while
+they're being written are buffered, see write_integrand(). Value of
+items with invalid volume is NaN. If integrand closes its output or
+doesn't read requests or answer a request within --integrand-timeout
+seconds, it's restarted and items without an answer fail. Time from the previous
+answer, or from writing requests, to answer of every item is traced.
+'''
+def integrate(integrand, work_items, calls, args, continued = False):
+	answers = [None for work_item in work_items]
+
+	def trace_answer(i, start):
+		if trace != None:
+			trace.add('worker', 'integrate', start, time(), work_items[i].cell_id, ('+' if continued else '') + str(calls[i]))
+
+	if isinstance(integrand, Plugin_Integrand):
+		for i in range(len(work_items)):
+			work_item = work_items[i]
+			if any(extent[0] >= extent[1] for extent in work_item.volume):
+				print('Rank', rank, 'invalid extent for cell', work_item.cell_id, ', returning NaN')
+				answers[i] = (float('NaN'), float('NaN'), None, None, None)
+				continue
+			try:
+				start = time()
+				answers[i] = integrand.integrate(work_item, calls[i], continued)
+				trace_answer(i, start)
+			except Exception as e:
+				print('Rank', rank, 'call to integrand failed, returning NaN, volume:', work_item.volume, ', exception:', e)
+		return answers, integrand
+
+	to_stdins = []
+	for i in range(len(work_items)):
+		to_stdin = format_request(integrand, work_items[i], calls[i], continued)
+		if to_stdin == None:
+			print('Rank', rank, 'invalid extent for cell', work_items[i].cell_id, ', returning NaN')
+			answers[i] = (float('NaN'), float('NaN'), None, None, None)
+		to_stdins.append(to_stdin)
+
+	if to_stdins.count(None) == len(to_stdins):
+		return answers, integrand
+
+	start = time()
+	try:
+		if not write_integrand(integrand, b''.join([to_stdin for to_stdin in to_stdins if to_stdin != None]), get_timeout(args)):
+			raise RuntimeError('integrand closed its output or stopped reading requests')
+	except Exception as e:
+		print('Rank', rank, 'request to integrand failed with input', to_stdins, ', error:', e)
+		return answers, restart_integrand(integrand, args, time() - start)
+
+	for i in range(len(to_stdins)):
+		if to_stdins[i] == None:
+			continue
+		try:
+			answers[i] = read_answer(integrand, get_deadline(args))
+		except Exception as e:
+			print('Rank', rank, 'call to integrand failed, input:', to_stdins[i], ', exception:', e)
+			return answers, restart_integrand(integrand, args, time() - start)
+		integrand_stats['consecutive'] = 0
+		trace_answer(i, start)
+		start = time()
+
+	return answers, integrand
+
+
+'''
+Integrates given grid by giving its cells to given workers until all cells converged.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param comm MPI communicator of all ranks.
+\param grid Cell_Store to integrate, converged cells are removed from it and added to its totals.
+\param workers Ranks of workers or sub-masters to give cells to.
+\param top_level True on rank 0, which checks target error.
+\param journal Journal in which to record changes to grid, if any.
+
+\return List of ranks of workers that failed.
+
+Cells are given to workers in lists of Work_Items, workers must return
+them after processing in the same order. Workers aren't told to quit.
+'''
+def schedule(args, comm, grid, workers, top_level, journal = None):
+	dimensions = list(range(args.dimensions))
+
+	# tracker for every worker
+	work_trackers = [Work_Tracker() for i in range(len(workers))]
+	for work_tracker in work_trackers:
+		work_tracker.processing = False
+
+	if args.verbose:
+		print('Number of work item slots:', len(work_trackers))
+		stdout.flush()
 
-	def __str__(self):
-		ret_val = 'Id: ' + str(self.cell_id) + ', Vol: '
-		for extent in self.volume:
-			ret_val += '[' + str(extent[0]) + ', ' + str(extent[1]) + '], '
-		return ret_val
+	# total time workers waited for new work and number of such waits
+	dispatch_latency = 0.0
+	dispatched = 0
+	# integrand restarts reported by workers and seconds lost to them
+	restarts = 0
+	lost_time = 0.0
+	# cells returned by workers and integrand calls they took, including copies and cells split by workers
+	received_cells = 0
+	received_calls = 0.0
+	# number of times each cell was lost by a worker
+	retries = {}
+
+	queue = Work_Queue(grid, args.schedule == 'error')
+	# indices of workers with room in their queue, once per free slot
+	free_slots = deque()
+	for i in range(max(1, args.prefetch)):
+		free_slots.extend(range(len(work_trackers)))
+	nr_failed = 0
+	# moving average of seconds workers spend per call, for sizing batches
+	time_per_call = None
+	# for finding slow cells and workers
+	call_times = Call_Times()
+	# for giving cells different numbers of calls
+	allocator = None
+	if args.allocation == 'error':
+		allocator = Call_Allocator(args)
+
+	# posted receive for every worker processing cells, None otherwise
+	requests = [None for i in range(len(work_trackers))]
+	# pickled results don't fit into default buffer of irecv in high dimensions
+	recv_buffers = [
+		bytearray(2**16 + args.max_batch * (512 + 32 * len(dimensions)))
+		for i in range(len(work_trackers))
+	]
+	# for waking up at deadlines while blocking in Waitsome
+	wake_up = Wake_Up.create(comm)
+
+	while True:
+
+		# fill queues of workers
+		while len(free_slots) > 0:
+			if work_trackers[free_slots[0]].processing == None:
+				free_slots.popleft()
+				continue
 
-	__repr__ = __str__
+			batch_size, batch_calls = get_batch_size(args, queue, time_per_call, (len(work_trackers) - nr_failed) * max(1, args.prefetch))
+			work_items = []
+			while len(work_items) < batch_size:
+				# next cell would probably take batch over its calls
+				if len(work_items) > 0 and batch_calls != None and get_list_calls(args, work_items) * (len(work_items) + 1) / len(work_items) > batch_calls:
+					break
+				c = queue.take()
+				if c == None:
+					break
+				work_item = Work_Item()
+				work_item.converged = False
+				work_item.cell_id = c
+				work_item.volume = grid.get_extents(c)
+				if allocator != None:
+					work_item.calls = allocator.get_calls(grid, c)
+				work_items.append(work_item)
+
+			# give idle worker a copy of a slow cell, first result is used
+			if len(work_items) == 0:
+				c = None
+				if not work_trackers[free_slots[0]].processing:
+					c = find_straggler(args, queue, work_trackers, call_times)
+				if c == None:
+					break
+				queue.copies[c] = 2
+				if args.verbose:
+					print('Giving copy of slow cell', c, 'to rank', workers[free_slots[0]])
+					stdout.flush()
+				work_item = Work_Item()
+				work_item.converged = False
+				work_item.cell_id = c
+				work_item.volume = grid.get_extents(c)
+				if allocator != None:
+					work_item.calls = allocator.get_calls(grid, c)
+				work_items.append(work_item)
+
+			proc = free_slots.popleft()
+			if args.verbose:
+				print('Sending cells', [work_item.cell_id for work_item in work_items], 'for processing to rank', workers[proc])
+				stdout.flush()
+			# don't block on workers that are busy with previous cells
+			work_trackers[proc].send_requests.append(comm.isend(obj = work_items, dest = workers[proc], tag = 1))
+			work_trackers[proc].in_flight.append(work_items)
+			if trace != None:
+				now = time()
+				for work_item in work_items:
+					trace.add('master', 'dispatch', now, cell = work_item.cell_id, info = workers[proc])
+			if not work_trackers[proc].processing:
+				work_trackers[proc].processing = True
+				work_trackers[proc].start_time = datetime.now()
+			if requests[proc] == None:
+				requests[proc] = comm.irecv(recv_buffers[proc], source = workers[proc], tag = 1)
 
 
-'''
-Used by rank 0 to keep track of worker ranks.
-'''
-class Work_Tracker:
-	def __init__(self):
-		self.item = None
-		self.processing = None
-		self.start_time = None
+		if args.verbose:
+			print(queue.work_left, 'work left,', queue.processing, 'processing')
+		if trace != None:
+			trace.snapshot('master', [
+				('work_left', queue.work_left),
+				('processing', queue.processing),
+				('ready', queue.work_left - queue.processing),
+				('busy_workers', sum(1 for work_tracker in work_trackers if work_tracker.processing))
+			])
+
+		if queue.work_left <= 0:
+			stdout.flush()
+			break
 
+		if top_level and target_reached(args, grid, queue):
+			if args.verbose:
+				print('Target error reached with', queue.work_left, 'cells not converged')
+				stdout.flush()
+			# use estimates of unfinished cells in final result
+			for c in grid.get_cells():
+				if not grid.get(c, 'converged') and grid.get(c, 'value') == None:
+					value, error = queue.get_estimate(c)
+					grid.set(c, 'value', value)
+					grid.set(c, 'error', error)
+			break
+
+		if nr_failed >= len(workers):
+			print('All workers failed, exiting...')
+			stdout.flush()
+			break
 
-'''
-Returns basic info about the calculated solution.
+		# remaining cells are stuck on failed workers
+		if requests.count(None) == len(requests):
+			print('No work left that can be processed, exiting...')
+			stdout.flush()
+			break
+
+
+		# wait for results until next timeout, or until a cell becomes slow
+		# enough to be copied to an idle worker
+		deadline = None
+		call_timeout = get_call_timeout(args, call_times)
+		typical = None
+		if len(free_slots) > 0 and args.speculate > 0:
+			typical = call_times.quantile(0.5, 10)
+		for proc in range(len(work_trackers)):
+			if len(work_trackers[proc].in_flight) == 0 or work_trackers[proc].start_time == None:
+				continue
+			timeouts = []
+			if requests[proc] != None and call_timeout > 0:
+				timeouts.append(get_expected_time(args, work_trackers[proc], call_timeout))
+			if typical != None and any(work_item.cell_id not in queue.copies for work_item in work_trackers[proc].in_flight[0]):
+				timeouts.append(args.speculate * get_expected_time(args, work_trackers[proc], typical))
+			for seconds in timeouts:
+				timeout = work_trackers[proc].start_time + timedelta(seconds = seconds)
+				if deadline == None or timeout < deadline:
+					deadline = timeout
+
+		wait_start = time()
+		ready, results = wait_for_results(requests, deadline, wake_up)
+		if trace != None:
+			trace.add('master', 'wait', wait_start, time())
+
+		for proc, work_items in zip(ready, results):
+			now = datetime.now()
+			requests[proc] = None
+
+			if isinstance(work_items, Split_Notice):
+				notice = work_items
+				requests[proc] = comm.irecv(recv_buffers[proc], source = workers[proc], tag = 1)
+				c = notice.cell_id
+				if c not in grid:
+					print('Cell', notice.cell_id, 'not in grid')
+					stdout.flush()
+					exit(1)
+				if args.verbose:
+					print('Rank', workers[proc], 'split cell', notice.cell_id, 'along dimensions', notice.split_dims)
+					stdout.flush()
+				if trace != None:
+					trace.add('master', 'split', time(), cell = c, info = ' '.join(str(d) for d in notice.split_dims))
+				coefficient = None
+				if allocator != None:
+					coefficient = allocator.add_result(c, notice.first_error, notice.error, grid.get_volume(c))
+				children = split_unconverged(grid, queue, c, notice.split_dims, notice.value, notice.error, notice.kept, journal, notice.halves, args.min_value)
+				kept = c * 2**len(notice.split_dims) + notice.kept
+				if allocator != None:
+					allocator.split(c, coefficient, children, 2**len(notice.split_dims), kept)
+				work_trackers[proc].split_locally(args, c, kept)
+				continue
 
-\param grid Integration grid.
+			# worker starts processing next list in its queue, if any
+			calls = get_list_calls(args, work_trackers[proc].in_flight.pop(0)) + work_trackers[proc].local_calls
+			work_trackers[proc].send_requests.pop(0).wait()
+			processing_time = (now - work_trackers[proc].start_time).total_seconds()
+			work_trackers[proc].local_calls = 0.0
+			if len(work_trackers[proc].in_flight) > 0:
+				work_trackers[proc].start_time = now
+				requests[proc] = comm.irecv(recv_buffers[proc], source = workers[proc], tag = 1)
+			else:
+				work_trackers[proc].processing = False
+			received_cells += len(work_items)
+			received_calls += calls
+			if work_items[0].idle_time != None:
+				dispatch_latency += work_items[0].idle_time
+				dispatched += 1
+			if work_items[0].restarts != None:
+				restarts += work_items[0].restarts
+				lost_time += work_items[0].lost_time
+			if args.verbose:
+				print('Received result for cells', [work_item.cell_id for work_item in work_items], 'from process', workers[proc])
+				stdout.flush()
+			if trace != None:
+				received = time()
+				for work_item in work_items:
+					trace.add('master', 'receive', received, cell = work_item.cell_id, info = workers[proc])
+
+			seconds = processing_time / max(1.0, calls)
+			call_times.add(seconds)
+			if time_per_call == None:
+				time_per_call = seconds
+			else:
+				time_per_call = 0.8 * time_per_call + 0.2 * seconds
+
+			for work_item in work_items:
+				c = work_item.cell_id
+				# number of other workers still processing a copy of cell
+				copies_left = 0
+				if c in queue.copies:
+					queue.copies[c] -= 1
+					copies_left = queue.copies[c]
+					if copies_left == 0:
+						del queue.copies[c]
+					if c not in grid:
+						if args.verbose:
+							print('Ignoring result for cell', c, 'from rank', workers[proc], 'as other copy finished first')
+							stdout.flush()
+						continue
 
-\return Tuple with current integral's value, error, NaN volume, total volume, number of converged cells and total number of grid cells.
-'''
-def get_info(grid):
-	converged_cells = grid.graph.graph['nr-cells']
-	# sum up final result
-	nan_vol = grid.graph.graph['nan-volume']
-	total_vol = nan_vol + grid.graph.graph['converged-volume']
-	value = grid.graph.graph['value']
-	error = grid.graph.graph['error']
+				if c not in grid:
+					print('Cell', work_item.cell_id, 'not in grid')
+					stdout.flush()
+					exit(1)
 
-	cells = grid.get_cells()
-	for c in cells:
-		if c.data['converged']:
-			converged_cells += 1
+				if work_item.value == None and work_item.converged:
+					print('Worker', workers[proc], 'failed')
+					stdout.flush()
+					work_trackers[proc].processing = None
+					if copies_left == 0:
+						grid.set(c, 'value', None)
+						grid.set(c, 'error', None)
+						queue.put_back(c)
+					continue
 
-		vol = 1
-		extents = c.get_extents()
-		for extent in extents:
-			vol *= extents[extent][1] - extents[extent][0]
-		total_vol += vol
+				if work_item.lost and copies_left > 0:
+					continue
+				if work_item.lost:
+					retries[c] = retries.get(c, 0) + 1
+					if retries[c] <= args.max_retries:
+						print('Rank', workers[proc], 'lost cell', c, ', retrying it')
+						stdout.flush()
+						queue.put_back(c)
+						continue
+					print('Cell', c, 'lost', retries[c], 'times, giving up on it')
+					stdout.flush()
+					work_item.value = float('NaN')
+					work_item.error = float('NaN')
+					work_item.converged = True
+				retries.pop(c, None)
+
+				coefficient = None
+				if allocator != None:
+					coefficient = allocator.add_result(c, work_item.first_error, work_item.error, grid.get_volume(c))
+
+				if not work_item.converged:
+					if args.verbose:
+						print("Cell", work_item.cell_id, "didn't converge, splitting along dimensions", work_item.split_dims)
+						stdout.flush()
+					if trace != None:
+						trace.add('master', 'split', time(), cell = c, info = ' '.join(str(d) for d in work_item.split_dims))
+					children = split_unconverged(grid, queue, c, work_item.split_dims, work_item.value, work_item.error, None, journal, work_item.halves, args.min_value)
+					if allocator != None:
+						allocator.split(c, coefficient, children, 2**len(work_item.split_dims))
+				else:
+					if trace != None:
+						trace.add('master', 'converge', time(), cell = c)
+					if allocator != None:
+						allocator.remove(c)
+					queue.converge(c)
+					converge_cell(grid, c, work_item.value, work_item.error, work_item.totals, journal)
+					if top_level and work_item.totals != None:
+						scale_estimates(grid, queue)
+
+			if work_trackers[proc].processing == None:
+				nr_failed += 1
+				put_back_queued(work_trackers[proc], queue, 0)
+				abandon_worker(work_trackers[proc], requests[proc])
+				requests[proc] = None
+			else:
+				free_slots.append(proc)
 
-		if c.data['value'] != None:
-			if isnan(c.data['value']):
-				nan_vol += vol
+		# workers whose result is not ready in time
+		now = datetime.now()
+		for proc in range(len(work_trackers)):
+			if requests[proc] == None or call_timeout <= 0:
+				continue
+			processing_time = (now - work_trackers[proc].start_time).total_seconds()
+			if processing_time > get_expected_time(args, work_trackers[proc], call_timeout):
+				print('Marking rank', workers[proc], 'as failed due to exceeded processing time, work items', work_trackers[proc].in_flight[0])
+				nr_failed += 1
+				# result that arrives later isn't received so others process the cells
+				put_back_queued(work_trackers[proc], queue, 0)
+				abandon_worker(work_trackers[proc], requests[proc])
+				requests[proc] = None
+
+	# results still in flight, e.g. copies of cells or queued lists after
+	# target error was reached, are received and ignored so that workers
+	# aren't left sending to a master that quits or schedules next grid,
+	# workers that don't return them in time are considered failed
+	while requests.count(None) < len(requests):
+		deadline = None
+		call_timeout = get_call_timeout(args, call_times)
+		if call_timeout > 0:
+			for proc in range(len(work_trackers)):
+				if requests[proc] == None:
+					continue
+				timeout = work_trackers[proc].start_time + timedelta(seconds = get_expected_time(args, work_trackers[proc], call_timeout))
+				if deadline == None or timeout < deadline:
+					deadline = timeout
+
+		ready, results = wait_for_results(requests, deadline, wake_up)
+		now = datetime.now()
+		for proc, result in zip(ready, results):
+			requests[proc] = None
+			if isinstance(result, Split_Notice):
+				work_trackers[proc].split_locally(args, result.cell_id, result.cell_id * 2**len(result.split_dims) + result.kept)
 			else:
-				value += c.data['value']
+				received_cells += len(result)
+				received_calls += get_list_calls(args, work_trackers[proc].in_flight.pop(0)) + work_trackers[proc].local_calls
+				work_trackers[proc].send_requests.pop(0).wait()
+				work_trackers[proc].start_time = now
+				work_trackers[proc].local_calls = 0.0
+			if len(work_trackers[proc].in_flight) > 0:
+				requests[proc] = comm.irecv(recv_buffers[proc], source = workers[proc], tag = 1)
+
+		if call_timeout <= 0:
+			continue
+		for proc in range(len(work_trackers)):
+			if requests[proc] == None:
+				continue
+			processing_time = (now - work_trackers[proc].start_time).total_seconds()
+			if processing_time > get_expected_time(args, work_trackers[proc], call_timeout):
+				print('Marking rank', workers[proc], 'as failed due to exceeded processing time of copies')
+				stdout.flush()
+				abandon_worker(work_trackers[proc], requests[proc])
+				requests[proc] = None
 
-		if c.data['error'] != None and not isnan(c.data['error']):
-			error += c.data['error']
+	if wake_up != None:
+		wake_up.close()
 
-	return value, error, nan_vol, total_vol, converged_cells, len(cells) + grid.graph.graph['nr-cells']
+	if args.verbose and dispatched > 0:
+		print('Rank', comm.Get_rank(), 'average dispatch latency', dispatch_latency / dispatched, 's over', dispatched, 'messages')
+		stdout.flush()
+	if restarts > 0:
+		print('Rank', comm.Get_rank(), 'workers restarted integrands', restarts, 'times, losing', lost_time, 's of integration')
+		stdout.flush()
+	if args.verbose and allocator != None:
+		print('Rank', comm.Get_rank(), 'requested', allocator.total, 'calls from integrands')
+		stdout.flush()
+	if args.summary and top_level:
+		print('Received', received_cells, 'cells integrated with', received_calls, 'calls')
+		stdout.flush()
+
+	return [workers[proc] for proc in range(len(workers)) if work_trackers[proc].processing == None]
 
 
 '''
-Prepares an integrand with Popen.
+Returns dimensions in which to split a cell that didn't converge.
 
 \param args Result from parse_args() of argparse.ArgumentParser in __main__.
+\param split_dim Dimension suggested by integrand.
+\param scores Score of splitting along every dimension from integrand, higher meaning more need to split, None if not known.
 
-\return Value returned by Popen.
+With --split-policy single or without scores only split_dim is returned.
+Otherwise up to --split-dims dimensions with highest scores are returned,
+with policy similar only those whose score is at least --split-ratio times
+the highest score.
 '''
-def prepare_integrand(args):
-	arg_list = [args.integrand]
-	if args.args != None:
-		arg_list += shlex.split(args.args)
-	integrand = Popen(arg_list, stdin = PIPE, stdout = PIPE, universal_newlines = True, bufsize = 1)
-	if args.verbose:
-		print('Integrand initialized by rank', rank)
+def choose_split_dims(args, split_dim, scores):
+	if \
+		args.split_policy == 'single' \
+		or args.split_dims <= 1 \
+		or scores == None \
+		or len(scores) != args.dimensions \
+		or any(isnan(score) for score in scores) \
+	:
+		return [split_dim]
+
+	ranked = sorted(range(len(scores)), key = lambda d: scores[d], reverse = True)
+	top_score = scores[ranked[0]]
+	if top_score <= 0:
+		return [split_dim]
+
+	split_dims = []
+	for d in ranked[:args.split_dims]:
+		if args.split_policy == 'similar' and scores[d] < args.split_ratio * top_score:
+			break
+		split_dims.append(d)
+	return split_dims
+
+
+'''
+Integrates volumes of given work items twice and checks whether results converged.
+
+\param integrand Integrand returned by prepare_integrand()
+\param work_items List of Work_Items to process
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+
+\return Integrand to use for subsequent integrations.
+
+Sets value, error, first_error, converged, split_dims and halves of every
+work item. Items whose integral is NaN converge, items that integrand
+didn't finish are lost. Second integration adds samples to those of the
+first one if continues_samples(). Items are integrated with their calls,
+or --calls if not set.
+'''
+def process(integrand, work_items, args):
+	for work_item in work_items:
+		work_item.value = float('NaN')
+		work_item.error = float('NaN')
+		work_item.first_error = None
+		work_item.converged = False
+		work_item.split_dims = None
+		work_item.halves = None
+		work_item.lost = False
+
+	def get_calls(work_items, factor):
+		return [factor * (args.calls if work_item.calls == None else work_item.calls) for work_item in work_items]
+
+	answers, integrand = integrate(integrand, work_items, get_calls(work_items, 1), args)
+	checked_items = []
+	for work_item, answer in zip(work_items, answers):
+		if answer == None:
+			work_item.lost = True
+		elif isnan(answer[0]):
+			work_item.converged = True
+		else:
+			work_item.value, work_item.error = answer[:2]
+			work_item.first_error = work_item.error
+			checked_items.append(work_item)
+
 	stdout.flush()
+
+	# check convergence
+	if continues_samples(args):
+		answers, integrand = integrate(integrand, checked_items, get_calls(checked_items, args.calls_factor - 1), args, True)
+	else:
+		answers, integrand = integrate(integrand, checked_items, get_calls(checked_items, args.calls_factor), args)
+	for work_item, answer in zip(checked_items, answers):
+		if answer == None:
+			work_item.lost = True
+			continue
+		new_value, new_error, new_split_dim, halves, scores = answer
+		if isnan(new_value):
+			work_item.value = new_value
+			work_item.converged = True
+			continue
+
+		try:
+			convg_fact = max(abs(work_item.value), abs(new_value)) / min(abs(work_item.value), abs(new_value))
+		except:
+			convg_fact = 0.0
+		convg_diff = abs(work_item.value - new_value)
+		work_item.value = new_value
+		work_item.error = new_error
+
+		if \
+			convg_fact < args.convergence_factor \
+			or convg_diff < args.convergence_diff \
+			or abs(new_value) < args.min_value \
+		:
+			if args.verbose:
+				print('Rank', rank, 'cell', work_item.cell_id, 'converged')
+				stdout.flush()
+			work_item.converged = True
+		else:
+			work_item.split_dims = choose_split_dims(args, new_split_dim, scores)
+			# halves are only known along the dimension suggested by integrand
+			if work_item.split_dims == [new_split_dim]:
+				work_item.halves = halves
+			if args.verbose:
+				print('Rank', rank, 'cell', work_item.cell_id, "didn't converge, returning split dimensions", work_item.split_dims)
+				stdout.flush()
+
 	return integrand
 
 
@@ -187,10 +2630,15 @@ if __name__ == '__main__':
 		action = 'store_true',
 		help = 'Print diagnostic information during integration'
 	)
+	parser.add_argument(
+		'--summary',
+		action = 'store_true',
+		help = 'Before the result print numbers of cells returned by workers and integrand calls they took, including copies of cells given with --speculate'
+	)
 	parser.add_argument(
 		'--integrand',
 		default = '',
-		help = 'Path to integrand program to use, relative to current working directory'
+		help = 'Path to integrand program to use, relative to current working directory, or to integrand shared object (ending with .so) to load into workers (see integrands/plugin.h)'
 	)
 	parser.add_argument(
 		'--dimensions',
@@ -227,12 +2675,119 @@ if __name__ == '__main__':
 		default = 1e6,
 		help = 'Request this number of calls to integrand'
 	)
+	parser.add_argument(
+		'--allocation',
+		choices = ['fixed', 'error'],
+		default = 'fixed',
+		help = 'Request --calls calls for every cell (fixed), or give cells with larger error per call estimated from parent and from recent results of nearby cells more calls and others fewer (error)'
+	)
+	parser.add_argument(
+		'--min-calls',
+		type = float,
+		default = 1e4,
+		help = 'Request at least this number of calls for a cell with --allocation error'
+	)
+	parser.add_argument(
+		'--max-calls',
+		type = float,
+		default = 1e8,
+		help = 'Request at most this number of calls for a cell with --allocation error'
+	)
 	parser.add_argument(
 		'--timer',
 		type = int,
 		default = 9999,
 		metavar = 'T',
-		help = 'Consider workers that do not return a result within T seconds as failed'
+		help = 'Consider workers that do not return a result within T seconds per cell as failed, no time limit if T <= 0, limit of cells with more or fewer calls than --calls is scaled by their calls'
+	)
+	parser.add_argument(
+		'--adaptive-timeout',
+		type = float,
+		default = 0,
+		metavar = 'A',
+		help = 'If A > 0 consider workers as failed already after A times the 95th percentile of recent processing times per call times calls of their cells if that is less than --timer, once 20 times are known, cells of failed workers are given to others'
+	)
+	parser.add_argument(
+		'--speculate',
+		type = float,
+		default = 0,
+		metavar = 'S',
+		help = 'If S > 0, when a worker is idle and no cell is ready give it a copy of a cell whose worker has taken S times longer than the median time per call times calls of its cells and use whichever result arrives first, not used with --local-refine'
+	)
+	parser.add_argument(
+		'--integrand-host',
+		default = '',
+		metavar = 'S',
+		help = 'Instead of starting --integrand, workers send requests to integrands/host listening on unix socket S (host --socket S), which serves all workers of a node with one process'
+	)
+	parser.add_argument(
+		'--integrand-timeout',
+		type = float,
+		default = 0,
+		metavar = 'I',
+		help = 'Restart integrand of a worker that does not answer a request within I seconds and process the request again, no time limit if I <= 0 (integrands loaded from shared objects are never restarted)'
+	)
+	parser.add_argument(
+		'--max-retries',
+		type = int,
+		default = 3,
+		metavar = 'R',
+		help = 'Process again at most R times a cell whose integrand was restarted before finishing it, after which its volume counts as NaN'
+	)
+	parser.add_argument(
+		'--max-batch',
+		metavar = 'K',
+		type = int,
+		default = 1,
+		help = 'Send at most K cells to a worker in one message, integrand receives all of them before answering'
+	)
+	parser.add_argument(
+		'--batch-time',
+		metavar = 'B',
+		type = float,
+		default = 1,
+		help = 'Size batches of cells so that processing one takes about B seconds based on average time per call and calls of cells'
+	)
+	parser.add_argument(
+		'--prefetch',
+		metavar = 'P',
+		type = int,
+		default = 1,
+		help = 'Keep up to P messages of cells queued for every worker so that it can start on the next one without waiting for rank 0'
+	)
+	parser.add_argument(
+		'--group-size',
+		metavar = 'G',
+		type = int,
+		default = 0,
+		help = 'If G > 0 rank 0 gives subtrees of cells to sub-masters that each give cells to G workers of their own and return only totals'
+	)
+	parser.add_argument(
+		'--local-refine',
+		metavar = 'N',
+		type = int,
+		default = 0,
+		help = 'Let workers split a cell that did not converge up to N times, continuing with one child and giving the others back to rank 0 as new work'
+	)
+	parser.add_argument(
+		'--split-policy',
+		choices = ['single', 'top', 'similar'],
+		default = 'single',
+		help = 'Split a cell that did not converge only along dimension suggested by integrand (single), along K dimensions with highest scores from integrand (top), or along up to K dimensions whose score is at least R times the highest (similar), giving 2**K children in one step. Integrands that do not return scores always use single (see integrands/README.md)'
+	)
+	parser.add_argument(
+		'--split-dims',
+		metavar = 'K',
+		type = int,
+		default = 2,
+		help = 'Maximum number of dimensions to split a cell in at once with --split-policy top or similar'
+	)
+	parser.add_argument(
+		'--split-ratio',
+		metavar = 'R',
+		type = float,
+		default = 0.5,
+		help = 'With --split-policy similar also split along dimensions whose score is at least R times the highest score'
 	)
 	parser.add_argument(
 		'--calls-factor',
@@ -241,6 +2796,17 @@ if __name__ == '__main__':
 		default = 2,
 		help = 'Increase number of calls by factor F when checking for convergence'
 	)
+	parser.add_argument(
+		'--protocol',
+		choices = ['text', 'binary'],
+		default = 'text',
+		help = 'Exchange requests and results with integrand as lines of text or as binary frames, falling back to text if integrand does not support binary (see integrands/protocol.hpp)'
+	)
+	parser.add_argument(
+		'--continue-samples',
+		action = 'store_true',
+		help = 'Check for convergence by asking integrand to add calls to those of first integration until there are F times more, instead of integrating again from scratch with F times more calls, only for integrands that support continuing (see integrands/README.md)'
+	)
 	parser.add_argument(
 		'--convergence-factor',
 		metavar = 'O',
@@ -266,20 +2832,59 @@ if __name__ == '__main__':
 		'--restart',
 		metavar = 'R',
 		default = '',
-		help = 'If R exists continue integration from result in R, write result to R every I seconds (do not continue from result files of untrusted sources)'
+		help = 'If R exists continue integration from result in R, record changes to result in R during integration (do not continue from result files of untrusted sources)'
 	)
 	parser.add_argument(
 		'--restart-interval',
 		metavar = 'I',
 		type = int,
 		default = -1,
-		help = 'If I > 0 write result to file R every I seconds during integration'
+		help = 'If I > 0 record changes to result in file R, flushing it to disk every I seconds'
 	)
 	parser.add_argument(
 		'--inspect',
 		default = '',
 		help = 'If not empty, print information about given restart file and exit'
 	)
+	parser.add_argument(
+		'--trace',
+		metavar = 'P',
+		default = '',
+		help = 'If not empty, every rank records timeline of its events in P.<rank>.csv and integrand programs in P.<rank>.integrand.csv, convert with --convert-trace'
+	)
+	parser.add_argument(
+		'--trace-interval',
+		metavar = 'Q',
+		type = float,
+		default = 1,
+		help = 'Record snapshot of work queue in trace at most every Q seconds'
+	)
+	parser.add_argument(
+		'--convert-trace',
+		metavar = 'P',
+		default = '',
+		help = 'If not empty, convert trace files P.*.csv recorded with --trace P into Chrome trace format in P.json, viewable with Perfetto, and exit'
+	)
+	parser.add_argument(
+		'--schedule',
+		choices = ['fifo', 'error'],
+		default = 'fifo',
+		help = 'Order in which to process cells: oldest first (fifo) or largest error estimate first (error), estimate of a cell being half of its parent\'s error plus absolute value'
+	)
+	parser.add_argument(
+		'--target-error',
+		metavar = 'E',
+		type = float,
+		default = 0,
+		help = 'If E > 0 stop integrating when sum of converged cells\' errors and other cells\' error estimates is below E'
+	)
+	parser.add_argument(
+		'--target-relative-error',
+		metavar = 'L',
+		type = float,
+		default = 0,
+		help = 'If L > 0 stop integrating when sum of converged cells\' errors and other cells\' error estimates is below L times absolute value of integral'
+	)
 
 	args = parser.parse_args()
 
@@ -294,17 +2899,30 @@ if __name__ == '__main__':
 			if not exists(args.inspect):
 				print('Restart file', args.inspect, "doesn't exist")
 				exit(1)
-			with open(args.inspect, 'rb') as restartfile:
-				grid = load(restartfile)
-			value, error, nan_vol, total_vol, converged, nr_cells = get_info(grid)
+			if is_journal(args.inspect):
+				value, error, nan_vol, total_vol, converged, nr_cells = get_journal_info(args.inspect)
+			else:
+				grid = load_pickled_grid(args.inspect)
+				value, error, nan_vol, total_vol, converged, nr_cells = get_info(grid)
 			print('Value:', value, 'error:', error, 'NaN volume/total:', nan_vol / total_vol, ',', converged, '/', nr_cells, 'converged cells')
 		exit()
 
+	if args.convert_trace != '':
+		if rank == 0:
+			nr_events = convert_trace(args.convert_trace)
+			print('Wrote', nr_events, 'events to', args.convert_trace + '.json')
+		exit()
+
 	if comm.size < 2:
 		if rank == 0:
 			print('At least 2 processes required')
 		exit(1)
 
+	if args.group_size > 0 and comm.size < 3:
+		if rank == 0:
+			print('At least 3 processes required with sub-masters')
+		exit(1)
+
 	if rank == 0 and args.verbose:
 		print('Starting with', comm.size, 'processes')
 		stdout.flush()
@@ -314,17 +2932,31 @@ if __name__ == '__main__':
 			print('Number of dimensions must be at least 1')
 		exit(1)
 
-	if not exists(args.integrand):
+	if args.integrand_host == '' and not exists(args.integrand):
 		print('Integrand', args.integrand, "doesn't exist")
 		exit(1)
 
 
 	dimensions = list(range(args.dimensions))
 
+	if args.trace != '':
+		trace = Trace(get_trace_path(args.trace, rank), args.trace_interval)
+
+	# ranks this rank gives work to, None for workers, and rank giving work to this one
+	groups = get_groups(comm.size, args.group_size)
+	group = None
+	master = 0
+	for sub_master, group_workers in groups:
+		if rank == sub_master:
+			group = group_workers
+		if rank in group_workers:
+			master = sub_master
+
 	if rank == 0:
 
 		# prepare grid for integration
 		grid = None
+		journal = None
 		restart = False
 
 		if args.restart != '' and exists(args.restart):
@@ -333,309 +2965,189 @@ if __name__ == '__main__':
 		if restart:
 			if args.verbose:
 				print('Restarting from', args.restart, end = '...  ')
-			with open(args.restart, 'rb') as restartfile:
-				grid = load(restartfile)
+			if is_journal(args.restart):
+				grid, journal = load_journal(args.restart, args.restart_interval)
+				if args.restart_interval <= 0:
+					journal = None
+			else:
+				# pickled grid of old versions doesn't record split dimensions
+				grid = load_pickled_grid(args.restart)
+				if args.restart_interval > 0:
+					print('Restart file', args.restart, 'is in old format, not recording changes to it')
 
 			converged = 0
 			for c in grid.get_cells():
-				if c.data['converged']:
+				if grid.get(c, 'converged'):
 					converged += 1
-				c.data['processing'] = False
-			print(converged, '/', len(grid.get_cells()), 'converged')
+				grid.set(c, 'processing', False)
+			print(converged, '/', len(grid), 'converged')
+			if journal != None:
+				journal.start()
 
 		else:
-			c = cell()
-			c.data['id'] = 1
-			c.data['processing'] = False
-			c.data['converged'] = False
-			c.data['value'] = None
-			c.data['error'] = None
-			for i in dimensions:
-				c.set_extent(i, args.min_extent, args.max_extent)
-			grid = ndgrid(c)
-			# remove converged cells to conserve memory, track final result with these
-			grid.graph.graph['converged-volume'] = 0.0
-			grid.graph.graph['nan-volume'] = 0.0
-			grid.graph.graph['value'] = 0.0
-			grid.graph.graph['error'] = 0.0
-			grid.graph.graph['nr-cells'] = 0
+			grid = Cell_Store(len(dimensions))
+			grid.add(1, [(args.min_extent, args.max_extent) for i in dimensions])
+			if args.restart != '' and args.restart_interval > 0:
+				journal = Journal(args.restart, grid.get_extents(1), args.restart_interval)
+				journal.start()
 
 			for i in range(args.prerefine):
-				split(choice(grid.get_cells()), 1, [randint(0, len(dimensions) - 1)], grid)
+				split(choice(grid.get_cells()), 1, [randint(0, len(dimensions) - 1)], grid, journal)
 			if args.verbose:
-				print('Grid initialized by rank', rank, 'with', len(grid.get_cells()), 'cells')
+				print('Grid initialized by rank', rank, 'with', len(grid), 'cells')
 				stdout.flush()
 
-		# tracker for every rank > 0
-		work_trackers = [Work_Tracker() for i in range(comm.size - 1)]
-		for work_tracker in work_trackers:
-			work_tracker.processing = False
-			work_tracker.item = Work_Item()
-
-		if args.verbose:
-			print('Number of work item slots:', len(work_trackers))
-			stdout.flush()
+		if args.group_size < 1:
+			schedule(args, comm, grid, group, True, journal)
+		else:
+			# give sub-masters whole subtrees, without time limit
+			split_until(grid, 4 * len(groups), dimensions, journal)
+			top_args = argparse.Namespace(**vars(args))
+			top_args.max_batch = 1
+			top_args.prefetch = 1
+			top_args.timer = 0
+			top_args.allocation = 'fixed'
+			group = [sub_master for sub_master, group_workers in groups]
+			schedule(top_args, comm, grid, group, True, journal)
 
-		next_restart = datetime.now() + timedelta(seconds = args.restart_interval)
-		while True:
-			sleep(0.1)
+		# tell others to quit
+		for i in group:
+			comm.send(obj = [Work_Item()], dest = i, tag = 1)
+		if journal != None:
+			journal.close()
+		if trace != None:
+			trace.close()
 
-			# write restart if needed
-			now = datetime.now()
-			if args.restart_interval > 0 and next_restart <= now:
-				if args.verbose:
-					print('Writing restart file at', now.isoformat().split('.')[0])
-				next_restart += timedelta(seconds = args.restart_interval)
+		value, error, nan_vol, total_vol, converged, nr_cells = get_info(grid)
+		print(value, error, nan_vol / total_vol)
 
-				if exists(args.restart):
-					rename(args.restart, args.restart + '-' + now.isoformat().split('.')[0])
-				with open(args.restart, 'wb') as restartfile:
-					dump(grid, restartfile)
 
+	elif group != None: # sub-master
 
-			work_left = 0
-			processing = 0
-			for c in grid.get_cells():
-				if not c.data['converged']:
-					work_left += 1
-				if c.data['processing']:
-					processing += 1
-			if args.verbose:
-				print(work_left, 'work left,', processing, 'processing')
+		# failed workers are dropped from group but still told to quit
+		workers = list(group)
+		while True:
+			work_items = comm.recv(source = 0, tag = 1)
+			if work_items[0].cell_id == None:
+				for i in workers:
+					comm.send(obj = [Work_Item()], dest = i, tag = 1)
+				if trace != None:
+					trace.close()
+				if args.verbose:
+					print('Rank', rank, 'exiting')
+					stdout.flush()
+				exit()
 
-			nr_failed = 0
-			for proc in range(len(work_trackers)):
+			for work_item in work_items:
+				subgrid = Cell_Store(len(dimensions))
+				subgrid.add(work_item.cell_id, work_item.volume)
 
-				# failed worker
-				if work_trackers[proc].processing == None:
-					nr_failed += 1
+				failed = schedule(args, comm, subgrid, group, False)
+				group = [i for i in group if i not in failed]
+				if len(group) == 0:
+					print('All workers of rank', rank, 'failed')
+					stdout.flush()
+					# tells rank 0 to give subtree to someone else
+					work_item.value = None
+					work_item.converged = True
 					continue
 
-				# idle worker
-				if not work_trackers[proc].processing:
-
-					# find cell to process
-					for c in grid.get_cells():
-						if c.data['converged'] or c.data['processing']:
-							if c.data['processing']:
-								processing += 1
-							continue
-
-						# found
-						found = True
-						work_trackers[proc].processing = True
-						c.data['processing'] = True
-						work_trackers[proc].item.converged = False
-						work_trackers[proc].item.cell_id = c.data['id']
-						work_trackers[proc].item.volume = [c.get_extent(dim) for dim in dimensions]
-						if args.verbose:
-							print('Sending cell', c.data['id'], 'for processing to rank', proc + 1)
-							stdout.flush()
-						comm.send(obj = work_trackers[proc].item, dest = proc + 1, tag = 1)
-						work_trackers[proc].start_time = datetime.now()
-						break
-
-				else:
-
-					# if result ready
-					if comm.Iprobe(source = proc + 1, tag = 1):
-						work_left -= 1
-						work_trackers[proc].processing = False
-						work_trackers[proc].item = comm.recv(source = proc + 1, tag = 1)
-						cell_id = work_trackers[proc].item.cell_id
-						if args.verbose:
-							print('Received result for cell', cell_id, 'from process', proc + 1)
-							stdout.flush()
-						found = False
-						for c in grid.get_cells():
-							if c.data['id'] == cell_id:
-								found = True
-								break
-						if not found:
-							print('Cell', cell_id, 'not in grid')
-							stdout.flush()
-							exit(1)
-						for c in grid.get_cells():
-							if c.data['id'] == cell_id:
-								c.data['processing'] = False
-								c.data['converged'] = work_trackers[proc].item.converged
-								if work_trackers[proc].item.value == None and work_trackers[proc].item.converged:
-									print('Worker', proc + 1, 'failed')
-									stdout.flush()
-									work_trackers[proc].processing = None
-									c.data['converged'] = False
-									c.data['value'] = None
-									c.data['error'] = None
-									break
-								c.data['value'] = work_trackers[proc].item.value
-								c.data['error'] = work_trackers[proc].item.error
-								split_dim = work_trackers[proc].item.split_dim
-								if not c.data['converged']:
-									if args.verbose:
-										print("Cell didn't converge, splitting along dimension", split_dim)
-										stdout.flush()
-									split(c, 1, [split_dim], grid)
-									work_left += 2
-								else:
-									grid.graph.graph['nr-cells'] += 1
-									vol = 1.0
-									extents = c.get_extents()
-									for extent in extents:
-										vol *= extents[extent][1] - extents[extent][0]
-									if isnan(c.data['value']):
-										grid.graph.graph['nan-volume'] += vol
-									else:
-										grid.graph.graph['converged-volume'] += vol
-										grid.graph.graph['value'] += c.data['value']
-									if not isnan(c.data['error']):
-										grid.graph.graph['error'] += c.data['error']
-									grid.remove(c)
-								break
-
-					# if result not ready
-					else:
-						processing_time = (datetime.now() - work_trackers[proc].start_time).seconds
-						if processing_time > args.timer:
-							print('Marking rank', proc + 1, 'as failed due to exceeded processing time, work item', work_trackers[proc].item)
-							work_trackers[proc].processing = None
-							break
-
-
-			if work_left <= 0:
-				stdout.flush()
-				break
-
-			if nr_failed >= comm.size - 1:
-				print('All workers failed, exiting...')
-				stdout.flush()
-				break
+				# cells that couldn't be processed count as failed volume
+				for c in subgrid.get_cells():
+					subgrid.totals['nan-volume'] += subgrid.get_volume(c)
 
-		# tell others to quit
-		for i in range(1, comm.size):
-			comm.send(obj = Work_Item(), dest = i, tag = 1)
+				work_item.totals = dict(subgrid.totals)
+				work_item.value = work_item.totals['value']
+				work_item.error = work_item.totals['error']
+				work_item.converged = True
 
-		value, error, nan_vol, total_vol, converged, nr_cells = get_info(grid)
-		print(value, error, nan_vol / total_vol)
+			comm.send(obj = work_items, dest = 0, tag = 1)
 
 
-	else: # if rank == 0
+	else: # worker
 
 		integrand = prepare_integrand(args)
 
 		# work loop
+		first_item = True
 		while True:
 			if args.verbose:
 				print('Rank', rank, 'waiting for work')
 				stdout.flush()
 
-			work_item = comm.recv(source = 0, tag = 1)
-			if work_item.cell_id == None:
+			wait_start = datetime.now()
+			work_items = comm.recv(source = master, tag = 1)
+			if trace != None:
+				trace.add('worker', 'idle', wait_start.timestamp(), time())
+			# dispatch latency, first item would include startup of rank 0
+			if not first_item:
+				work_items[0].idle_time = (datetime.now() - wait_start).total_seconds()
+			first_item = False
+
+			if work_items[0].cell_id == None:
 				if args.verbose:
 					print('Rank', rank, 'exiting')
 					stdout.flush()
+				if isinstance(integrand, Plugin_Integrand):
+					integrand.close()
+				else:
+					# don't leave behind a hung integrand
+					integrand.stdin.close()
+					try:
+						integrand.wait(timeout = 1)
+					except Exception:
+						integrand.kill()
+				if trace != None:
+					trace.close()
 				exit()
 
 			if args.verbose:
-				print('Rank', rank, 'processing cell', work_item.cell_id)
+				print('Rank', rank, 'processing cells', [work_item.cell_id for work_item in work_items])
 				stdout.flush()
 
-			work_item.value = float('NaN')
-			work_item.error = float('NaN')
-			work_item.converged = False
-
-			failed = False
-			to_stdin = '{:.16e} '.format(args.calls)
-			for extent in work_item.volume:
-				ext_str = '{:.16e} {:.16e} '.format(extent[0], extent[1])
-				first, second = ext_str.split()
-				if first == second or float(first) >= float(second):
-					failed = True
+			# refine unconverged cells locally up to given number of times
+			processing = work_items
+			for refinement in range(max(0, args.local_refine) + 1):
+				integrand = process(integrand, processing, args)
+				if refinement >= args.local_refine:
 					break
-				to_stdin += ext_str
-			if failed:
-				print('Rank', rank, 'invalid extent, returning NaN')
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
-
-			try:
-				integrand.stdin.write(to_stdin + '\n')
-				integrand.stdin.flush()
-			except Exception as e:
-				print('Rank', rank, 'request to integrand failed with input', to_stdin, ', error:', e)
-				integrand = prepare_integrand(args)
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
 
-			stdout.flush()
-
-			try:
-				answer = integrand.stdout.readline()
-				value, error, split_dim = answer.strip().split()
-				work_item.value, work_item.error, work_item.split_dim = float(value), float(error), int(split_dim)
-			except Exception as e:
-				print('Rank', rank, 'call to integrand failed with result:', answer, ', returning NaN, input string:', to_stdin, ', exception:', e)
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
-
-			# check convergence
-			failed = False
-			time_start = datetime.now()
-			to_stdin = '{:.16e} '.format(args.calls * args.calls_factor)
-			for extent in work_item.volume:
-				ext_str = '{:.16e} {:.16e} '.format(extent[0], extent[1])
-				first, second = ext_str.split()
-				if first == second or float(first) >= float(second):
-					failed = True
+				refining = []
+				for work_item in processing:
+					if work_item.converged or isnan(work_item.value) or work_item.split_dims == None:
+						continue
+					# continue with first child, rank 0 gives the others to someone else
+					notice = Split_Notice()
+					notice.cell_id = work_item.cell_id
+					notice.split_dims = work_item.split_dims
+					notice.kept = 0
+					notice.value = work_item.value
+					notice.error = work_item.error
+					notice.first_error = work_item.first_error
+					notice.halves = work_item.halves
+					comm.send(obj = notice, dest = master, tag = 1)
+					if args.verbose:
+						print('Rank', rank, 'split cell', work_item.cell_id, 'in dimensions', work_item.split_dims, 'continuing with child', work_item.cell_id * 2**len(work_item.split_dims))
+						stdout.flush()
+
+					# first child is lower half in every split dimension, see split()
+					work_item.cell_id = work_item.cell_id * 2**len(work_item.split_dims)
+					for d in work_item.split_dims:
+						extent = work_item.volume[d]
+						work_item.volume[d] = (extent[0], (extent[0] + extent[1]) / 2)
+					work_item.halves = None
+					refining.append(work_item)
+
+				if len(refining) == 0:
 					break
-				to_stdin += ext_str
-			if failed:
-				print('Rank', rank, 'invalid extent, returning NaN')
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
-
-			try:
-				integrand.stdin.write(to_stdin + '\n')
-				integrand.stdin.flush()
-			except Exception as e:
-				print('Rank', rank, 'request to integrand failed with input', to_stdin, ', error:', e)
-				integrand = prepare_integrand(args)
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
-
-			try:
-				answer = integrand.stdout.readline()
-				new_value, new_error, new_split_dim = answer.strip().split()
-				new_value, new_error, new_split_dim = float(new_value), float(new_error), int(new_split_dim)
-			except Exception as e:
-				print('Rank', rank, 'call to integrand failed with result:', answer, ', returning NaN, input string:', to_stdin, ', exception:', e)
-				comm.send(obj = work_item, dest = 0, tag = 1)
-				continue
-
-			try:
-				convg_fact = max(abs(work_item.value), abs(new_value)) / min(abs(work_item.value), abs(new_value))
-			except:
-				convg_fact = 0.0
-			convg_diff = abs(work_item.value - new_value)
-			work_item.value = new_value
-			work_item.error = new_error
+				processing = refining
 
-			if \
-				convg_fact < args.convergence_factor \
-				or convg_diff < args.convergence_diff \
-				or abs(new_value) < args.min_value \
-			:
-				if args.verbose:
-					print('Rank', rank, 'converged')
-					stdout.flush()
-				work_item.converged = True
-			else:
-				if args.verbose:
-					print('Rank', rank, "didn't converge, returning split dimension", new_split_dim)
-					stdout.flush()
-				work_item.value = work_item.error = None
-				work_item.split_dim = new_split_dim
+			work_items[0].restarts = integrand_stats['restarts']
+			work_items[0].lost_time = integrand_stats['lost-time']
+			integrand_stats['restarts'] = 0
+			integrand_stats['lost-time'] = 0.0
 
 			if args.verbose:
 				print('Rank', rank, 'returning work')
 				stdout.flush()
-			comm.send(obj = work_item, dest = 0, tag = 1)
+			comm.send(obj = work_items, dest = master, tag = 1)
@@ -19,115 +19,422 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 
 #include "algorithm"
+#include "chrono"
 #include "cmath"
 #include "cstdlib"
-#include "iomanip"
+#include "cstring"
 #include "ios"
 #include "iostream"
-#include "sstream"
+#include "map"
+#include "new"
+#include "random"
 #include "string"
 #include "vector"
 
+#include "N-sphere_kernels.hpp"
+#include "integration_threads.hpp"
+#include "plugin.h"
+#include "protocol.hpp"
 #include "gsl_monte_plain2.h"
 #include "gsl/gsl_monte_plain.h"
 
 
 /*
-Same as integrand in example1.py
+Samples of an integration volume kept for continuing its integration.
 */
-double integrand(double* x, size_t dim, void* /*params*/) {
-	double arg_to_sqrt = 1;
-	for (size_t i = 0; i < dim; i++) {
-		arg_to_sqrt -= (*(x + i)) * (*(x + i));
+struct Volume_State {
+	std::vector<int> split_dims;
+	gsl_monte_plain2_sums* samples = nullptr;
+
+	Volume_State() = default;
+	Volume_State(const Volume_State&) = delete;
+	Volume_State& operator=(const Volume_State&) = delete;
+
+	~Volume_State() {
+		gsl_monte_plain2_sums_free(samples);
 	}
-	return std::sqrt(std::max(0.0, arg_to_sqrt));
-}
+
+	/*
+	Discards samples of volume with given number of dimensions.
+
+	Returns false if memory couldn't be allocated.
+	*/
+	bool reset(const size_t dimensions) {
+		split_dims.assign(dimensions, 0);
+		if (samples == nullptr) {
+			samples = gsl_monte_plain2_sums_alloc(dimensions);
+		} else {
+			gsl_monte_plain2_sums_init(samples);
+		}
+		return samples != nullptr;
+	}
+};
 
 
 /*
-Reads integration volume from stdin and prints the result to stdout.
+Samples of volumes of one client, previous_continued telling whether
+its latest request was continued.
+*/
+struct Client_Samples {
+	std::map<std::vector<double>, Volume_State> volumes;
+	bool previous_continued = false;
+};
 
-Input format, line by line:
-nr_calls v0min v0max v1min v1max ...
+
+/*
+Integrates volumes with gsl plain mc.
+
+Samples of volumes are kept for continuing their integration, if
+requested, separately for every client until a request of the client
+that isn't continued follows one that is. Calls of every request are
+split between given number of threads.
 */
-int main(int argc, char* /*argv*/[])
-{
-	if (argc != 1) {
-		std::cerr << "Invalid number of arguments: " << argc - 1 << " should be 0." << std::endl;
-		return EXIT_FAILURE;
+class Integrator {
+public:
+
+	Integrator(const size_t nr_threads) :
+		threads(nr_threads)
+	{
+		this->function.f = nullptr;
+		this->function.params = nullptr;
 	}
 
-	std::cout << std::setprecision(15) << std::scientific;
+	Integrator(const Integrator&) = delete;
+	Integrator& operator=(const Integrator&) = delete;
 
-	gsl_rng_env_setup();
-	const gsl_rng_type* const rng_t = gsl_rng_default;
-	gsl_rng* rng = gsl_rng_alloc(rng_t);
+	~Integrator() {
+		this->clients.clear();
+		if (this->state != nullptr) {
+			gsl_monte_plain_free(this->state);
+		}
+	}
 
-	gsl_monte_function function;
-	function.f = &integrand;
-	function.params = nullptr;
+	/*
+	Seeds random number generators.
+	*/
+	void seed(const unsigned long seed) {
+		this->threads.seed(seed);
+	}
 
-	size_t dimensions = 0;
-	bool first_integration = true;
+	/*
+	Frees samples kept for given client.
+	*/
+	void forget(const unsigned long client) {
+		this->clients.erase(client);
+	}
 
-	decltype(gsl_monte_plain_alloc(0)) state{};
+	/*
+	Integrates volume from mins to maxs with given number of calls for given client.
 
-	std::string line;
-	while (std::getline(std::cin, line)) {
+	Samples are kept for continuing integration of volume only if
+	keep_samples is true. Value and error of lower and upper half of volume along split_dim
+	are written to halves[0..3], NaN if not available, and score of
+	splitting volume along every dimension to scores[0..dimensions-1].
 
-		double calls, item;
-		std::istringstream iss(line);
-		std::vector<double> mins, maxs;
-		iss >> calls;
-		while (iss >> item) {
-			mins.push_back(item);
-			if (iss >> item) {
-				maxs.push_back(item);
-			} else {
-				break;
+	Returns false and prints the reason to stderr if integration failed.
+	*/
+	bool integrate(
+		const unsigned long client,
+		const bool keep_samples,
+		const double* mins,
+		const double* maxs,
+		const size_t dimensions,
+		const double calls,
+		const bool continuing,
+		double& result,
+		double& abserr,
+		int& split_dim,
+		double* halves,
+		double* scores
+	) {
+		if (this->state == nullptr or this->dimensions != dimensions) {
+			if (this->state != nullptr) {
+				gsl_monte_plain_free(this->state);
 			}
+			this->state = gsl_monte_plain_alloc(dimensions);
+			this->function.f = get_n_sphere_isa().get(dimensions);
 		}
-		if (mins.size() == 0) {
-			break;
-		}
-		if (mins.size() != maxs.size()) {
-			std::cerr << "Number of minimum and maximum extents differs" << std::endl;
-			return EXIT_FAILURE;
+		this->dimensions = dimensions;
+
+		auto& samples = this->clients[client];
+		if (not keep_samples or (not continuing and samples.previous_continued)) {
+			samples.volumes.clear();
 		}
+		samples.previous_continued = continuing;
 
-		if (first_integration) {
-			first_integration = false;
-			state = gsl_monte_plain_alloc(mins.size());
-		} else if (dimensions != mins.size()) {
-			gsl_monte_plain_free(state);
-			state = gsl_monte_plain_alloc(mins.size());
+		std::vector<double> extents(mins, mins + dimensions);
+		extents.insert(extents.end(), maxs, maxs + dimensions);
+		auto& volume = samples.volumes[extents];
+		if (
+			(not continuing or volume.split_dims.size() == 0)
+			and not volume.reset(dimensions)
+		) {
+			std::cerr << "Couldn't allocate memory for samples." << std::endl;
+			return false;
 		}
-		dimensions = mins.size();
 
-		function.dim = dimensions;
-		std::vector<int> split_dims(dimensions);
-		double result = 0, abserr = 0;
-		const auto ret_val = gsl_monte_plain_integrate2(
-			&function,
-			mins.data(),
-			maxs.data(),
+		this->function.dim = dimensions;
+		const auto ret_val = gsl_monte_plain_integrate2_batch_threaded_continue(
+			&this->function,
+			mins,
+			maxs,
 			dimensions,
 			size_t(std::round(calls)),
-			rng,
-			state,
+			this->threads.all_rngs(),
+			this->threads.pool(),
+			this->state,
+			volume.samples,
 			&result,
 			&abserr,
-			split_dims.data()
+			volume.split_dims.data()
 		);
 		if (ret_val != 0) {
 			std::cerr << "Integration failed." << std::endl;
-			return EXIT_FAILURE;
+			return false;
 		}
-		const auto max_elem = std::max_element(split_dims.cbegin(), split_dims.cend());
-		std::cout << result << " " << abserr << " " << std::distance(split_dims.cbegin(), max_elem) << std::endl;
+		const auto max_elem = std::max_element(volume.split_dims.cbegin(), volume.split_dims.cend());
+		split_dim = std::distance(volume.split_dims.cbegin(), max_elem);
+		gsl_monte_plain2_halves(volume.samples, mins, maxs, split_dim, halves);
+		gsl_monte_plain2_scores(volume.samples, scores);
+		return true;
 	}
 
-	if (not first_integration) {
-		gsl_monte_plain_free(state);
+
+private:
+
+	Integration_Threads threads;
+	gsl_monte_batch2_function function;
+	size_t dimensions = 0;
+	decltype(gsl_monte_plain_alloc(0)) state = nullptr;
+	std::map<unsigned long, Client_Samples> clients;
+};
+
+
+/*
+Parses arguments [--threads N] [--benchmark] of integrand.
+
+Number of threads defaults to Integration_Threads::default_size().
+Returns false and prints the reason to stderr if arguments were invalid.
+*/
+bool parse_arguments(int argc, char* argv[], size_t& nr_threads, bool& benchmark)
+{
+	benchmark = false;
+	try {
+		nr_threads = Integration_Threads::default_size();
+		for (int i = 1; i < argc; i++) {
+			if (std::strcmp(argv[i], "--benchmark") == 0) {
+				benchmark = true;
+			} else if (std::strcmp(argv[i], "--threads") == 0 and i + 1 < argc) {
+				nr_threads = std::stoul(argv[++i]);
+			} else {
+				std::cerr << "Invalid argument: " << argv[i] << ", should be [--threads N] [--benchmark]" << std::endl;
+				return false;
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "Invalid number of threads: " << e.what() << std::endl;
+		return false;
+	}
+	if (nr_threads == 0) {
+		std::cerr << "Number of threads must be > 0" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+#ifdef HDINTEGRATOR_PLUGIN
+
+void* hdintegrator_init(int argc, char* argv[])
+{
+	size_t nr_threads = 1;
+	bool benchmark = false;
+	if (not parse_arguments(argc, argv, nr_threads, benchmark)) {
+		return nullptr;
+	}
+	if (benchmark) {
+		std::cerr << "--benchmark isn't supported by shared object" << std::endl;
+		return nullptr;
+	}
+	try {
+		return new Integrator(nr_threads);
+	} catch (const std::exception& e) {
+		std::cerr << "Couldn't create integrator: " << e.what() << std::endl;
+		return nullptr;
+	}
+}
+
+int hdintegrator_integrate(
+	void* handle,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+) {
+	try {
+		auto& integrator = *static_cast<Integrator*>(handle);
+		if (integrator.integrate(0, continuation_enabled(), mins, maxs, dimensions, calls, continued != 0, *value, *error, *split_dim, halves, scores)) {
+			return 0;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
 	}
+	return -1;
 }
+
+int hdintegrator_integrate_client(
+	void* handle,
+	unsigned long client,
+	int keep_samples,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+) {
+	try {
+		auto& integrator = *static_cast<Integrator*>(handle);
+		if (integrator.integrate(client, keep_samples != 0, mins, maxs, dimensions, calls, continued != 0, *value, *error, *split_dim, halves, scores)) {
+			return 0;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
+
+void hdintegrator_forget_client(void* handle, unsigned long client)
+{
+	static_cast<Integrator*>(handle)->forget(client);
+}
+
+void hdintegrator_seed(void* handle, unsigned long seed)
+{
+	static_cast<Integrator*>(handle)->seed(seed);
+}
+
+void hdintegrator_teardown(void* handle)
+{
+	delete static_cast<Integrator*>(handle);
+}
+
+#else
+
+/*
+Prints evaluations per second of every kernel supported by the CPU.
+*/
+void benchmark()
+{
+	constexpr size_t stride = GSL_MONTE_BATCH2_BLOCK, max_dimensions = 2 * n_sphere_max_unrolled;
+	std::mt19937_64 random_source;
+	std::uniform_real_distribution<double> coordinate(0, 1);
+	std::vector<double> x(max_dimensions * stride), values(stride);
+	for (auto& item: x) {
+		item = coordinate(random_source);
+	}
+
+	std::cout << "isa dimensions evaluations/s" << std::endl;
+	for (const auto& isa: get_n_sphere_isas()) {
+		if (not isa.supported()) {
+			continue;
+		}
+		for (size_t dimensions = 1; dimensions <= max_dimensions; dimensions++) {
+			const auto kernel = isa.get(dimensions);
+			const auto start = std::chrono::steady_clock::now();
+			double evaluations = 0, seconds = 0;
+			while (seconds < 0.1) {
+				for (size_t i = 0; i < 1000; i++) {
+					kernel(x.data(), stride, stride, dimensions, nullptr, values.data());
+				}
+				evaluations += 1000 * stride;
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			std::cout << isa.name << " " << dimensions << " " << evaluations / seconds << std::endl;
+		}
+	}
+}
+
+/*
+Reads integration volume from stdin and prints the result to stdout.
+
+Input format, line by line:
+nr_calls v0min v0max v1min v1max ...
+or binary frames, see protocol.hpp.
+
+If nr_calls starts with + they are added to samples of previous line
+with same volume, or a new integration is started if there isn't one.
+Samples are kept until a line without + follows one with +.
+
+Calls of every line are split between --threads N threads, by default
+from environment variable HDINTEGRATOR_THREADS or 1. Results depend on
+number of threads but are the same in every run with the same number.
+
+With --benchmark prints speed of integrand on every instruction set
+supported by the CPU instead.
+*/
+int main(int argc, char* argv[])
+{
+	std::ios_base::sync_with_stdio(false);
+
+	size_t nr_threads = 1;
+	bool benchmark_only = false;
+	if (not parse_arguments(argc, argv, nr_threads, benchmark_only)) {
+		return EXIT_FAILURE;
+	}
+	if (benchmark_only) {
+		benchmark();
+		return EXIT_SUCCESS;
+	}
+
+	const bool keep_samples = continuation_enabled();
+	Integrator integrator(nr_threads);
+	Integrand_IO io;
+	Integration_Request request;
+	std::vector<double> scores;
+	while (true) {
+
+		try {
+			if (not io.read(request)) {
+				break;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		double result = 0, abserr = 0;
+		int split_dim = 0;
+		double halves[4];
+		scores.resize(request.mins.size());
+		if (not integrator.integrate(
+			0,
+			keep_samples,
+			request.mins.data(),
+			request.maxs.data(),
+			request.mins.size(),
+			request.calls,
+			request.continued,
+			result,
+			abserr,
+			split_dim,
+			halves,
+			scores.data()
+		)) {
+			return EXIT_FAILURE;
+		}
+		io.write(result, abserr, split_dim, halves, scores.data(), scores.size());
+	}
+}
+
+#endif // ifdef HDINTEGRATOR_PLUGIN
@@ -0,0 +1,272 @@
+/*
+Vectorized N-sphere integrand selected at run time by instruction set.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HDINTEGRATOR_N_SPHERE_KERNELS_HPP
+#define HDINTEGRATOR_N_SPHERE_KERNELS_HPP
+
+
+#include "algorithm"
+#include "cmath"
+#include "cstddef"
+#include "utility"
+#include "vector"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HDINTEGRATOR_N_SPHERE_X86 1
+#include "immintrin.h"
+#endif
+
+
+/*
+Same as gsl_monte_batch2_function::f, see gsl/gsl_monte_batch2.h.
+*/
+using N_Sphere_Kernel = void (*)(
+	const double* x,
+	size_t n,
+	size_t stride,
+	size_t dim,
+	void* params,
+	double* values
+);
+
+/*
+Kernels are compiled for these numbers of dimensions so that loop over
+dimensions is unrolled, others use kernel for 0 that takes it from dim.
+*/
+constexpr size_t n_sphere_max_unrolled = 16;
+
+
+/*
+Same as integrand in example1.py evaluated at points first..n-1.
+
+Coordinate d of point i is x[d * stride + i]. Dim is the number of
+dimensions or 0 to use dim instead. Kernels below use this for points
+that don't fill a vector. AVX2 and AVX-512 kernels use fused multiply-add
+so last bits of values can depend on the CPU.
+*/
+template<size_t Dim> inline void n_sphere_points(
+	const double* x,
+	const size_t first,
+	const size_t n,
+	const size_t stride,
+	const size_t dim,
+	double* values
+) {
+	const size_t dims = Dim > 0 ? Dim : dim;
+	for (size_t i = first; i < n; i++) {
+		double value = 1;
+		for (size_t d = 0; d < dims; d++) {
+			value -= x[d * stride + i] * x[d * stride + i];
+		}
+		values[i] = std::sqrt(std::max(0.0, value));
+	}
+}
+
+
+/*
+Kernels without explicit vectorization for any CPU.
+*/
+struct N_Sphere_Generic {
+	static constexpr const char* name = "generic";
+
+	static bool supported() {
+		return true;
+	}
+
+	template<size_t Dim> static void evaluate(
+		const double* x,
+		size_t n,
+		size_t stride,
+		size_t dim,
+		void* /*params*/,
+		double* values
+	) {
+		n_sphere_points<Dim>(x, 0, n, stride, dim, values);
+	}
+};
+
+
+#ifdef HDINTEGRATOR_N_SPHERE_X86
+
+/*
+Kernels evaluating 2 points at a time with SSE2.
+*/
+struct N_Sphere_SSE2 {
+	static constexpr const char* name = "sse2";
+
+	static bool supported() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+	}
+
+	template<size_t Dim> __attribute__((target("sse2"))) static void evaluate(
+		const double* x,
+		size_t n,
+		size_t stride,
+		size_t dim,
+		void* /*params*/,
+		double* values
+	) {
+		const size_t dims = Dim > 0 ? Dim : dim;
+		const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1);
+		size_t i = 0;
+		for ( ; i + 2 <= n; i += 2) {
+			__m128d value = one;
+			for (size_t d = 0; d < dims; d++) {
+				const __m128d xd = _mm_loadu_pd(x + d * stride + i);
+				value = _mm_sub_pd(value, _mm_mul_pd(xd, xd));
+			}
+			_mm_storeu_pd(values + i, _mm_sqrt_pd(_mm_max_pd(value, zero)));
+		}
+		n_sphere_points<Dim>(x, i, n, stride, dim, values);
+	}
+};
+
+
+/*
+Kernels evaluating 4 points at a time with AVX2 and FMA.
+*/
+struct N_Sphere_AVX2 {
+	static constexpr const char* name = "avx2";
+
+	static bool supported() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma");
+	}
+
+	template<size_t Dim> __attribute__((target("avx2,fma"))) static void evaluate(
+		const double* x,
+		size_t n,
+		size_t stride,
+		size_t dim,
+		void* /*params*/,
+		double* values
+	) {
+		const size_t dims = Dim > 0 ? Dim : dim;
+		const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1);
+		size_t i = 0;
+		for ( ; i + 4 <= n; i += 4) {
+			__m256d value = one;
+			for (size_t d = 0; d < dims; d++) {
+				const __m256d xd = _mm256_loadu_pd(x + d * stride + i);
+				value = _mm256_fnmadd_pd(xd, xd, value);
+			}
+			_mm256_storeu_pd(values + i, _mm256_sqrt_pd(_mm256_max_pd(value, zero)));
+		}
+		n_sphere_points<Dim>(x, i, n, stride, dim, values);
+	}
+};
+
+
+/*
+Kernels evaluating 8 points at a time with AVX-512.
+
+Points that don't fill a vector are evaluated with masked instructions.
+*/
+struct N_Sphere_AVX512 {
+	static constexpr const char* name = "avx512f";
+
+	static bool supported() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512f");
+	}
+
+	template<size_t Dim> __attribute__((target("avx512f"))) static void evaluate(
+		const double* x,
+		size_t n,
+		size_t stride,
+		size_t dim,
+		void* /*params*/,
+		double* values
+	) {
+		const size_t dims = Dim > 0 ? Dim : dim;
+		const __m512d zero = _mm512_setzero_pd(), one = _mm512_set1_pd(1);
+		for (size_t i = 0; i < n; i += 8) {
+			const __mmask8 mask = n - i >= 8 ? 0xFF : (1 << (n - i)) - 1;
+			__m512d value = one;
+			for (size_t d = 0; d < dims; d++) {
+				const __m512d xd = _mm512_maskz_loadu_pd(mask, x + d * stride + i);
+				value = _mm512_fnmadd_pd(xd, xd, value);
+			}
+			value = _mm512_maskz_sqrt_pd(mask, _mm512_maskz_max_pd(mask, value, zero));
+			_mm512_mask_storeu_pd(values + i, mask, value);
+		}
+	}
+};
+
+#endif // ifdef HDINTEGRATOR_N_SPHERE_X86
+
+
+/*
+Returns kernel of instruction set ISA for given number of dimensions.
+*/
+template<class ISA, size_t... Dims> N_Sphere_Kernel get_n_sphere_kernel(
+	const size_t dimensions,
+	std::index_sequence<Dims...>
+) {
+	const N_Sphere_Kernel kernels[]{&ISA::template evaluate<Dims>...};
+	return dimensions < sizeof...(Dims) ? kernels[dimensions] : kernels[0];
+}
+
+template<class ISA> N_Sphere_Kernel get_n_sphere_kernel(const size_t dimensions) {
+	return get_n_sphere_kernel<ISA>(
+		dimensions,
+		std::make_index_sequence<n_sphere_max_unrolled + 1>()
+	);
+}
+
+
+/*
+Kernels of one instruction set.
+*/
+struct N_Sphere_ISA {
+	const char* name;
+	bool (*supported)();
+	N_Sphere_Kernel (*get)(size_t dimensions);
+};
+
+/*
+Returns instruction sets with kernels compiled in, best first,
+whether the CPU supports them or not.
+*/
+inline const std::vector<N_Sphere_ISA>& get_n_sphere_isas() {
+	static const std::vector<N_Sphere_ISA> isas{
+		#ifdef HDINTEGRATOR_N_SPHERE_X86
+		{N_Sphere_AVX512::name, &N_Sphere_AVX512::supported, &get_n_sphere_kernel<N_Sphere_AVX512>},
+		{N_Sphere_AVX2::name, &N_Sphere_AVX2::supported, &get_n_sphere_kernel<N_Sphere_AVX2>},
+		{N_Sphere_SSE2::name, &N_Sphere_SSE2::supported, &get_n_sphere_kernel<N_Sphere_SSE2>},
+		#endif
+		{N_Sphere_Generic::name, &N_Sphere_Generic::supported, &get_n_sphere_kernel<N_Sphere_Generic>}
+	};
+	return isas;
+}
+
+/*
+Returns best instruction set supported by the CPU running the program.
+*/
+inline const N_Sphere_ISA& get_n_sphere_isa() {
+	static const N_Sphere_ISA& best = *std::find_if(
+		get_n_sphere_isas().cbegin(),
+		get_n_sphere_isas().cend(),
+		[](const N_Sphere_ISA& isa){ return isa.supported(); }
+	);
+	return best;
+}
+
+#endif // ifndef HDINTEGRATOR_N_SPHERE_KERNELS_HPP
@@ -32,19 +32,27 @@ Selects which method to use.
 
 #include "algorithm"
 #include "array"
+#include "chrono"
 #include "cmath"
 #include "cstdlib"
-#include "iomanip"
 #include "ios"
 #include "iostream"
 #include "iterator"
-#include "sstream"
+#include "limits"
+#include "map"
+#include "new"
+#include "random"
 #include "stdexcept"
 #include "string"
+#include "utility"
 #include "vector"
 
 #include "boost/program_options.hpp"
 
+#include "integration_threads.hpp"
+#include "plugin.h"
+#include "protocol.hpp"
+
 #if METHOD == 1
 #include "gsl_monte_plain2.h"
 #include "gsl/gsl_monte_plain.h"
@@ -70,111 +78,275 @@ struct Integrand_Params
 	// correlate in these dimensions, (nx-1)*nt - 1...nx*nt-1
 	int corr1 = -1, corr2 = -1;
 	size_t nx = 0, nt = 0;
+	// number of threads integrating every volume
+	size_t threads = 1;
 };
 
 
-size_t index(const size_t x_i, const size_t t_i, const size_t nx, const size_t nt)
-{
-	return x_i % nx + (t_i % nt) * nx;
-}
+/*
+Number of points evaluated together by integrand, few enough for their
+transformed coordinates to fit on the stack.
+*/
+constexpr size_t burgers_lanes = 8;
+
+/*
+Integrand is compiled for lattices of up to this many points in x and t
+with neighbours known at compile time, larger lattices use generic code.
+*/
+constexpr size_t burgers_max_unrolled = 8;
 
 
 /*
 Integrand for single-time correlation function of burgers equation.
+
+Evaluates lanes points starting from x, coordinate d of point l being
+x[d * stride + l], and writes their values to values[0..lanes-1]. Nx, Nt
+and Lanes are number of lattice points in x and t and number of points
+to evaluate, or 0 to use params.nx, params.nt and lanes. t is space for
+nx * nt * burgers_lanes transformed coordinates. Lattice is periodic in
+both x and t. Parameters must have been checked by parse_options.
 */
-double integrand(double* x, size_t dimensions, void* integrand_params) {
-	const auto& params = *static_cast<Integrand_Params*>(integrand_params);
-	const auto
-		corr1 = params.corr1,
-		corr2 = params.corr2;
-	const auto
-		nx = params.nx,
-		nt = params.nt;
+template<size_t Nx, size_t Nt, size_t Lanes> void burgers_points(
+	const double* x,
+	const size_t given_lanes,
+	const size_t stride,
+	const Integrand_Params& params,
+	double* t,
+	double* values
+) {
+	const size_t
+		nx = Nx > 0 ? Nx : params.nx,
+		nt = Nt > 0 ? Nt : params.nt,
+		lanes = Lanes > 0 ? Lanes : given_lanes;
+
+	// transformed version, integration range -1..1 instead of -inf..inf,
+	// and factor from transform
+	for (size_t l = 0; l < lanes; l++) {
+		values[l] = 1;
+	}
+	for (size_t d = 0; d < nx * nt; d++) {
+		const double* const xd = x + d * stride;
+		double* const td = t + d * burgers_lanes;
+		for (size_t l = 0; l < lanes; l++) {
+			const double x2 = SQR(xd[l]), inv = 1 / (1 - x2);
+			td[l] = xd[l] * inv;
+			values[l] *= (1 + x2) * SQR(inv);
+		}
+	}
+
+	if (params.corr1 >= 0 and params.corr2 >= 0) {
+		const double
+			* const vel1 = t + (params.corr1 % nx) * burgers_lanes,
+			* const vel2 = t + (params.corr2 % nx) * burgers_lanes;
+		for (size_t l = 0; l < lanes; l++) {
+			values[l] = values[l] * vel1[l] * vel2[l];
+		}
+	}
+
+	double arg4exp[burgers_lanes]{};
+	for (size_t t_i = 0; t_i < nt; t_i++) {
+	for (size_t x_i = 0; x_i < nx; x_i++) {
+		const size_t
+			next_t = t_i + 1 < nt ? t_i + 1 : 0,
+			right_x = x_i + 1 < nx ? x_i + 1 : 0,
+			left_x = x_i > 0 ? x_i - 1 : nx - 1;
+		const double
+			* const t_next = t + (x_i + next_t * nx) * burgers_lanes,
+			* const t_here = t + (x_i + t_i * nx) * burgers_lanes,
+			* const t_right = t + (right_x + t_i * nx) * burgers_lanes,
+			* const t_left = t + (left_x + t_i * nx) * burgers_lanes;
+		for (size_t l = 0; l < lanes; l++) {
+			arg4exp[l] += SQR(
+				+ t_next[l]
+				+ t_here[l]
+				- t_right[l]
+				- t_left[l]
+				+ 0.5 * t_here[l] * (t_right[l] - t_left[l])
+			);
+		}
+	}}
+
+	for (size_t l = 0; l < lanes; l++) {
+		values[l] *= exp(-0.5 * arg4exp[l]);
+	}
+}
+
 
-	if (corr1 >= int(dimensions) or corr2 >= int(dimensions)) {
-		std::cerr << __FILE__ "(" << __LINE__ << ")" << std::endl;
-		abort();
+/*
+Integrand evaluated at n points given as struct of arrays, see
+gsl_monte_batch2.h and burgers_points.
+*/
+template<size_t Nx, size_t Nt> void integrand(
+	const double* x,
+	const size_t n,
+	const size_t stride,
+	const size_t /*dimensions*/,
+	void* integrand_params,
+	double* values
+) {
+	const auto& params = *static_cast<const Integrand_Params*>(integrand_params);
+
+	double lattice_t[(Nx > 0 and Nt > 0 ? Nx * Nt : 1) * burgers_lanes];
+	double* t = lattice_t;
+	if (Nx == 0 or Nt == 0) {
+		thread_local std::vector<double> generic_t;
+		generic_t.resize(params.nx * params.nt * burgers_lanes);
+		t = generic_t.data();
 	}
 
-	if (nx * nt != dimensions) {
-		std::cerr << __FILE__ "(" << __LINE__ << ")" << std::endl;
-		abort();
+	size_t i = 0;
+	for ( ; i + burgers_lanes <= n; i += burgers_lanes) {
+		burgers_points<Nx, Nt, burgers_lanes>(x + i, burgers_lanes, stride, params, t, values + i);
 	}
+	if (i < n) {
+		burgers_points<Nx, Nt, 0>(x + i, n - i, stride, params, t, values + i);
+	}
+}
 
-	const bool correlate = [&](){
-		if (corr1 < 0 or corr2 < 0) {
-			return false;
-		} else {
-			return true;
+
+using Integrand = decltype(gsl_monte_batch2_function::f);
+
+/*
+Returns integrand compiled for lattice of nx * nt points if there is one,
+generic integrand otherwise.
+*/
+template<size_t... Lattices> Integrand get_integrand(
+	const size_t nx,
+	const size_t nt,
+	std::index_sequence<Lattices...>
+) {
+	constexpr size_t max = burgers_max_unrolled;
+	const Integrand integrands[]{&integrand<Lattices % max + 1, Lattices / max + 1>...};
+	if (nx >= 1 and nx <= max and nt >= 1 and nt <= max) {
+		return integrands[(nx - 1) + (nt - 1) * max];
+	}
+	return &integrand<0, 0>;
+}
+
+Integrand get_integrand(const size_t nx, const size_t nt) {
+	return get_integrand(
+		nx,
+		nt,
+		std::make_index_sequence<burgers_max_unrolled * burgers_max_unrolled>()
+	);
+}
+
+
+/*
+Samples of an integration volume kept for continuing its integration.
+*/
+struct Volume_State {
+	std::vector<int> split_dims;
+	#if METHOD == 1
+	gsl_monte_plain2_sums* samples = nullptr;
+	#elif METHOD == 2
+	gsl_monte_miser2_sums samples{0, 0, 0};
+	#elif METHOD == 3
+	gsl_monte_vegas_state* samples = nullptr;
+	#endif
+
+	Volume_State() = default;
+	Volume_State(const Volume_State&) = delete;
+	Volume_State& operator=(const Volume_State&) = delete;
+
+	~Volume_State() {
+		#if METHOD == 1
+		gsl_monte_plain2_sums_free(samples);
+		#elif METHOD == 3
+		if (samples != nullptr) {
+			gsl_monte_vegas_free(samples);
 		}
-	}();
+		#endif
+	}
 
-	// transformed version, integration range -1..1 instead of -inf..inf
-	const std::vector<double> t = [x, dimensions](){
-		std::vector<double> ret_val(x, x + dimensions);
-		for (auto& i: ret_val) {
-			i = i / (1 - i*i);
+	/*
+	Discards samples of volume with given number of dimensions.
+
+	Returns false if memory couldn't be allocated.
+	*/
+	bool reset(const size_t dimensions) {
+		split_dims.assign(dimensions, 0);
+		#if METHOD == 1
+		if (samples == nullptr) {
+			samples = gsl_monte_plain2_sums_alloc(dimensions);
+		} else {
+			gsl_monte_plain2_sums_init(samples);
 		}
-		return ret_val;
-	}();
-
-	const double
-		transform_factor = [&](){
-			double ret_val = 1;
-			for (size_t t_i = 0; t_i < nt; t_i++) {
-			for (size_t x_i = 0; x_i < nx; x_i++) {
-				const double x2 = SQR(x[index(x_i, t_i, nx, nt)]);
-				ret_val *= (1 + x2) / SQR(1 - x2);
-			}}
-			return ret_val;
-		}(),
-		vel1 = [&]{
-			if (correlate) {
-				return t[index(corr1, 0, nx, nt)];
-			} else {
-				return 1.0;
-			}
-		}(),
-		vel2 = [&]{
-			if (correlate) {
-				return t[index(corr2, 0, nx, nt)];
-			} else {
-				return 1.0;
+		return samples != nullptr;
+		#elif METHOD == 2
+		samples = gsl_monte_miser2_sums{0, 0, 0};
+		return true;
+		#elif METHOD == 3
+		if (samples == nullptr) {
+			samples = gsl_monte_vegas_alloc(dimensions);
+		} else {
+			gsl_monte_vegas_init(samples);
+		}
+		return samples != nullptr;
+		#endif
+	}
+};
+
+
+/*
+Prints evaluations per second of integrand with given parameters and
+of generic integrand used for lattices without their own.
+*/
+void benchmark(const Integrand_Params& params)
+{
+	constexpr size_t stride = GSL_MONTE_BATCH2_BLOCK;
+	const size_t dimensions = params.nx * params.nt;
+	std::mt19937_64 random_source;
+	std::uniform_real_distribution<double> coordinate(-1, 1);
+	std::vector<double> x(dimensions * stride), values(stride);
+	for (auto& item: x) {
+		item = coordinate(random_source);
+	}
+
+	std::vector<std::pair<std::string, Integrand>> integrands;
+	if (get_integrand(params.nx, params.nt) != &integrand<0, 0>) {
+		integrands.emplace_back(
+			std::to_string(params.nx) + "x" + std::to_string(params.nt),
+			get_integrand(params.nx, params.nt)
+		);
+	}
+	integrands.emplace_back("generic", &integrand<0, 0>);
+
+	std::cout << "integrand evaluations/s" << std::endl;
+	for (const auto& item: integrands) {
+		const auto start = std::chrono::steady_clock::now();
+		double evaluations = 0, seconds = 0;
+		while (seconds < 0.2) {
+			for (size_t i = 0; i < 100; i++) {
+				item.second(x.data(), stride, stride, dimensions, const_cast<Integrand_Params*>(&params), values.data());
 			}
-		}(),
-		arg4exp = [&](){
-			double ret_val = 0;
-			for (size_t t_i = 0; t_i < nt; t_i++) {
-			for (size_t x_i = 0; x_i < nx; x_i++) {
-				ret_val += SQR(
-					+ t[index(x_i         , t_i + 1, nx, nt)]
-					+ t[index(x_i         , t_i    , nx, nt)]
-					- t[index(x_i + 1     , t_i    , nx, nt)]
-					- t[index(x_i + nx - 1, t_i    , nx, nt)]
-					+ 0.5 * t[index(x_i, t_i, nx, nt)]
-						* (
-							+ t[index(x_i + 1     , t_i, nx, nt)]
-							- t[index(x_i + nx - 1, t_i, nx, nt)]
-						)
-				);
-			}}
-			return ret_val;
-		}();
-
-	return transform_factor * vel1 * vel2 * exp(-0.5 * arg4exp);
+			evaluations += 100 * stride;
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::cout << item.first << " " << evaluations / seconds << std::endl;
+	}
 }
 
 
 /*
-Reads integration volume from stdin and prints the result to stdout.
+Parses command line options into given integrand parameters.
 
-Input format, line by line:
-nr_calls v0min v0max v1min v1max ...
+Returns EXIT_SUCCESS if integration can start, EXIT_FAILURE if options
+were invalid and -1 if help or benchmark was printed instead.
 */
-int main(int argc, char* argv[])
+int parse_options(int argc, char* argv[], Integrand_Params& params)
 {
 	int corr1 = 0, corr2 = 0;
-	size_t nx = 0, nt = 0;
+	size_t nx = 0, nt = 0, threads = 1;
+
+	try {
+		threads = Integration_Threads::default_size();
+	} catch (std::exception& e) {
+		std::cerr <<  __FILE__ << "(" << __LINE__ << "): "
+			<< "Invalid HDINTEGRATOR_THREADS: " << e.what()
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
 
 	boost::program_options::options_description
 		options("Usage: program_name [options], where options are");
@@ -191,7 +363,13 @@ int main(int argc, char* argv[])
 			"Number of grid points in x direction, nx*nt must equal number of dimension given on stdin")
 		("nt",
 			boost::program_options::value<size_t>(&nt)->required(),
-			"Number of grid points in t direction, nx*nt must equal number of dimension given on stdin");
+			"Number of grid points in t direction, nx*nt must equal number of dimension given on stdin")
+		#if METHOD == 1 or METHOD == 2
+		("threads",
+			boost::program_options::value<size_t>(&threads)->default_value(threads),
+			"Number of threads integrating every volume, default from environment variable HDINTEGRATOR_THREADS or 1")
+		#endif
+		("benchmark", "Print speed of integrand with given options instead of integrating");
 
 	boost::program_options::variables_map var_map;
 	try {
@@ -204,13 +382,13 @@ int main(int argc, char* argv[])
 			),
 			var_map
 		);
+		boost::program_options::notify(var_map);
 	} catch (std::exception& e) {
 		std::cerr <<  __FILE__ << "(" << __LINE__ << "): "
 			<< "Couldn't parse command line options: " << e.what()
 			<< std::endl;
 		return EXIT_FAILURE;
 	}
-	boost::program_options::notify(var_map);
 
 	if (nx == 0) {
 		std::cerr <<  __FILE__ << "(" << __LINE__ << "): "
@@ -225,136 +403,391 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (threads == 0) {
+		std::cerr <<  __FILE__ << "(" << __LINE__ << "): "
+			<< "Number of threads must be > 0"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (corr1 >= int(nx * nt) or corr2 >= int(nx * nt)) {
+		std::cerr <<  __FILE__ << "(" << __LINE__ << "): "
+			<< "Correlation dimensions must be < nx*nt"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+
 	if (var_map.count("help") > 0) {
 		std::cout << options << std::endl;
-		return EXIT_SUCCESS;
+		return -1;
 	}
 
+	params = Integrand_Params{corr1, corr2, nx, nt, threads};
 
-	gsl_rng_env_setup();
-	const gsl_rng_type* rng_t = gsl_rng_default;
-	gsl_rng* rng = gsl_rng_alloc(rng_t);
+	if (var_map.count("benchmark") > 0) {
+		benchmark(params);
+		return -1;
+	}
+	return EXIT_SUCCESS;
+}
 
-	std::cout << std::setprecision(15) << std::scientific;
 
-	gsl_monte_function function;
-	function.f = &integrand;
+/*
+Samples of volumes of one client, previous_continued telling whether
+its latest request was continued.
+*/
+struct Client_Samples {
+	std::map<std::vector<double>, Volume_State> volumes;
+	bool previous_continued = false;
+};
 
-	size_t dimensions = 0;
-	bool first_integration = true;
 
-	#if METHOD == 1
-	decltype(gsl_monte_plain_alloc(0)) state{};
-	#elif METHOD == 2
-	decltype(gsl_monte_miser_alloc(0)) state{};
-	#elif METHOD == 3
-	decltype(gsl_monte_vegas_alloc(0)) state{};
-	#endif
+/*
+Integrates volumes with gsl mc method selected by METHOD.
 
-	std::string line;
-	while (std::getline(std::cin, line)) {
-
-		double calls;
-		std::istringstream iss(line);
-		std::vector<double> mins, maxs;
-		double item;
-		iss >> calls;
-		while (iss >> item) {
-			mins.push_back(item);
-			if (iss >> item) {
-				maxs.push_back(item);
-			} else {
-				break;
-			}
-		}
-		if (mins.size() == 0) {
-			break;
+Samples of volumes are kept for continuing their integration, if
+requested, separately for every client until a request of the client
+that isn't continued follows one that is. With plain calls of every
+request are split between params.threads threads and with miser halves
+of bisections are integrated by them.
+*/
+class Integrator {
+public:
+
+	Integrator(const Integrand_Params& given_params) :
+		params(given_params),
+		threads(given_params.threads)
+	{
+		this->function.f = get_integrand(this->params.nx, this->params.nt);
+		this->function.params = &this->params;
+	}
+
+	Integrator(const Integrator&) = delete;
+	Integrator& operator=(const Integrator&) = delete;
+
+	~Integrator() {
+		this->clients.clear();
+		#if METHOD == 1
+		if (this->state != nullptr) {
+			gsl_monte_plain_free(this->state);
 		}
-		if (mins.size() != maxs.size()) {
-			std::cerr << "Number of minimum and maximum extents differs" << std::endl;
-			return EXIT_FAILURE;
+		#elif METHOD == 2
+		if (this->state != nullptr) {
+			gsl_monte_miser_free(this->state);
 		}
+		#endif
+	}
 
-		for (size_t i = 0; i < mins.size(); i++) {
+	/*
+	Seeds random number generators.
+	*/
+	void seed(const unsigned long seed) {
+		this->threads.seed(seed);
+	}
+
+	/*
+	Frees samples kept for given client.
+	*/
+	void forget(const unsigned long client) {
+		this->clients.erase(client);
+	}
+
+	/*
+	Integrates volume from mins to maxs with given number of calls for given client.
+
+	Samples are kept for continuing integration of volume only if
+	keep_samples is true. Value and error of lower and upper half of volume along split_dim
+	are written to halves[0..3], NaN if not available, and score of
+	splitting volume along every dimension to scores[0..dimensions-1].
+
+	Returns false and prints the reason to stderr if integration failed.
+	*/
+	bool integrate(
+		const unsigned long client,
+		const bool keep_samples,
+		const double* mins,
+		const double* maxs,
+		const size_t dimensions,
+		const double calls,
+		const bool continuing,
+		double& result,
+		double& error,
+		int& split_dim,
+		double* halves,
+		double* scores
+	) {
+		for (size_t i = 0; i < dimensions; i++) {
 			if (mins[i] >= maxs[i]) {
 				std::cerr << "Starting coordinate of " << i+1
 					<< "th dimension is not smaller than ending coordinate: "
 					<< mins[i] << " >= " << maxs[i]
 					<< std::endl;
-				return EXIT_FAILURE;
+				return false;
 			}
 		}
 
-		if (first_integration) {
-			first_integration = false;
-			#if METHOD == 1
-			state = gsl_monte_plain_alloc(mins.size());
-			#elif METHOD == 2
-			state = gsl_monte_miser_alloc(mins.size());
-			#elif METHOD == 3
-			state = gsl_monte_vegas_alloc(mins.size());
-			#endif
-		} else if (dimensions != mins.size()) {
-			#if METHOD == 1
-			gsl_monte_plain_free(state);
-			state = gsl_monte_plain_alloc(mins.size());
-			#elif METHOD == 2
-			gsl_monte_miser_free(state);
-			state = gsl_monte_miser_alloc(mins.size());
-			#elif METHOD == 3
-			gsl_monte_vegas_free(state);
-			state = gsl_monte_vegas_alloc(mins.size());
-			#endif
-		}
-		dimensions = mins.size();
-		if (dimensions != nx * nt) {
+		if (dimensions != this->params.nx * this->params.nt) {
 			std::cerr << "Number of dimensions not equal to nx*nt" << std::endl;
-			return EXIT_FAILURE;
+			return false;
+		}
+
+		#if METHOD == 1
+		if (this->state == nullptr or this->dimensions != dimensions) {
+			if (this->state != nullptr) {
+				gsl_monte_plain_free(this->state);
+			}
+			this->state = gsl_monte_plain_alloc(dimensions);
+		}
+		#elif METHOD == 2
+		if (this->state == nullptr or this->dimensions != dimensions) {
+			if (this->state != nullptr) {
+				gsl_monte_miser_free(this->state);
+			}
+			this->state = gsl_monte_miser_alloc(dimensions);
 		}
+		#endif
+		this->dimensions = dimensions;
 
-		function.dim = dimensions;
+		auto& samples = this->clients[client];
+		if (not keep_samples or (not continuing and samples.previous_continued)) {
+			samples.volumes.clear();
+		}
+		samples.previous_continued = continuing;
+
+		std::vector<double> extents(mins, mins + dimensions);
+		extents.insert(extents.end(), maxs, maxs + dimensions);
+		auto& volume = samples.volumes[extents];
+		if (
+			(not continuing or volume.split_dims.size() == 0)
+			and not volume.reset(dimensions)
+		) {
+			std::cerr << "Couldn't allocate memory for samples." << std::endl;
+			return false;
+		}
 
-		Integrand_Params params{corr1, corr2, nx, nt};
-		function.params = &params;
+		this->function.dim = dimensions;
 
-		std::vector<int> split_dims(dimensions);
-		double result = 0, error = 0;
 		#if METHOD == 1
-		auto ret_val = gsl_monte_plain_integrate2(
+		auto ret_val = gsl_monte_plain_integrate2_batch_threaded_continue(
 		#elif METHOD == 2
-		auto ret_val = gsl_monte_miser_integrate2(
+		auto ret_val = gsl_monte_miser_integrate2_batch_threaded_continue(
 		#elif METHOD == 3
-		auto ret_val = gsl_monte_vegas_integrate2(
+		auto ret_val = gsl_monte_vegas_integrate2_batch_continue(
 		#endif
-			&function,
-			mins.data(),
-			maxs.data(),
+			&this->function,
+			#if METHOD == 3
+			// vegas doesn't modify extents but doesn't take them as const
+			const_cast<double*>(mins),
+			const_cast<double*>(maxs),
+			#else
+			mins,
+			maxs,
+			#endif
 			dimensions,
 			size_t(std::round(calls)),
-			rng,
-			state,
+			#if METHOD == 1
+			this->threads.all_rngs(),
+			this->threads.pool(),
+			#elif METHOD == 2
+			this->threads.rng(),
+			this->threads.pool(),
+			#else
+			this->threads.rng(),
+			#endif
+			#if METHOD == 1
+			this->state,
+			volume.samples,
+			#elif METHOD == 2
+			this->state,
+			&volume.samples,
+			#elif METHOD == 3
+			volume.samples,
+			#endif
 			&result,
 			&error,
-			split_dims.data()
+			volume.split_dims.data()
 		);
 		if (ret_val != 0) {
 			std::cerr << "Integration failed." << std::endl;
-			return EXIT_FAILURE;
+			return false;
 		}
 
-		const auto max_elem = std::max_element(split_dims.cbegin(), split_dims.cend());
-		std::cout << result << " " << error << " " << std::distance(split_dims.cbegin(), max_elem) << std::endl;
-	}
-
-	if (not first_integration) {
+		const auto max_elem = std::max_element(volume.split_dims.cbegin(), volume.split_dims.cend());
+		split_dim = std::distance(volume.split_dims.cbegin(), max_elem);
 		#if METHOD == 1
-		gsl_monte_plain_free(state);
-		#elif METHOD == 2
-		gsl_monte_miser_free(state);
-		#elif METHOD == 3
-		gsl_monte_vegas_free(state);
+		gsl_monte_plain2_halves(volume.samples, mins, maxs, split_dim, halves);
+		gsl_monte_plain2_scores(volume.samples, scores);
+		#else
+		std::fill(halves, halves + 4, std::numeric_limits<double>::quiet_NaN());
+		// how many times integration suggested each dimension
+		std::copy(volume.split_dims.cbegin(), volume.split_dims.cend(), scores);
 		#endif
+		return true;
+	}
+
+
+private:
+
+	Integrand_Params params;
+	Integration_Threads threads;
+	gsl_monte_batch2_function function;
+	size_t dimensions = 0;
+
+	// vegas keeps its state with samples of each volume
+	#if METHOD == 1
+	decltype(gsl_monte_plain_alloc(0)) state = nullptr;
+	#elif METHOD == 2
+	decltype(gsl_monte_miser_alloc(0)) state = nullptr;
+	#endif
+
+	std::map<unsigned long, Client_Samples> clients;
+};
+
+
+#ifdef HDINTEGRATOR_PLUGIN
+
+void* hdintegrator_init(int argc, char* argv[])
+{
+	Integrand_Params params;
+	if (parse_options(argc, argv, params) != EXIT_SUCCESS) {
+		return nullptr;
+	}
+	try {
+		return new Integrator(params);
+	} catch (const std::exception& e) {
+		std::cerr << "Couldn't create integrator: " << e.what() << std::endl;
+		return nullptr;
+	}
+}
+
+int hdintegrator_integrate(
+	void* handle,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+) {
+	try {
+		auto& integrator = *static_cast<Integrator*>(handle);
+		if (integrator.integrate(0, continuation_enabled(), mins, maxs, dimensions, calls, continued != 0, *value, *error, *split_dim, halves, scores)) {
+			return 0;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
+
+int hdintegrator_integrate_client(
+	void* handle,
+	unsigned long client,
+	int keep_samples,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+) {
+	try {
+		auto& integrator = *static_cast<Integrator*>(handle);
+		if (integrator.integrate(client, keep_samples != 0, mins, maxs, dimensions, calls, continued != 0, *value, *error, *split_dim, halves, scores)) {
+			return 0;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
+
+void hdintegrator_forget_client(void* handle, unsigned long client)
+{
+	static_cast<Integrator*>(handle)->forget(client);
+}
+
+void hdintegrator_seed(void* handle, unsigned long seed)
+{
+	static_cast<Integrator*>(handle)->seed(seed);
+}
+
+void hdintegrator_teardown(void* handle)
+{
+	delete static_cast<Integrator*>(handle);
+}
+
+#else
+
+/*
+Reads integration volume from stdin and prints the result to stdout.
+
+Input format, line by line:
+nr_calls v0min v0max v1min v1max ...
+or binary frames, see protocol.hpp.
+
+If nr_calls starts with + they are added to samples of previous line
+with same volume, or a new integration is started if there isn't one.
+Samples are kept until a line without + follows one with +.
+*/
+int main(int argc, char* argv[])
+{
+	std::ios_base::sync_with_stdio(false);
+
+	Integrand_Params params;
+	const auto parsed = parse_options(argc, argv, params);
+	if (parsed != EXIT_SUCCESS) {
+		return parsed == EXIT_FAILURE ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	const bool keep_samples = continuation_enabled();
+	Integrator integrator(params);
+	Integrand_IO io;
+	Integration_Request request;
+	std::vector<double> scores;
+	while (true) {
+
+		try {
+			if (not io.read(request)) {
+				break;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		double result = 0, error = 0;
+		int split_dim = 0;
+		double halves[4];
+		scores.resize(request.mins.size());
+		if (not integrator.integrate(
+			0,
+			keep_samples,
+			request.mins.data(),
+			request.maxs.data(),
+			request.mins.size(),
+			request.calls,
+			request.continued,
+			result,
+			error,
+			split_dim,
+			halves,
+			scores.data()
+		)) {
+			return EXIT_FAILURE;
+		}
+		io.write(result, error, split_dim, halves, scores.data(), scores.size());
 	}
 
 	return EXIT_SUCCESS;
 }
+
+#endif // ifdef HDINTEGRATOR_PLUGIN
@@ -0,0 +1,97 @@
+/* gsl_monte_batch2.h
+ *
+ * Copyright 2017 Ilja Honkonen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Functions evaluated at a block of points in one call, used by the
+   integrate2 routines of plain2.c, miser2.c and vegas2.c, which generate
+   points and accumulate their statistics a block at a time. */
+#ifndef __GSL_MONTE_BATCH2_H__
+#define __GSL_MONTE_BATCH2_H__
+
+#include <stddef.h>
+#include <gsl/gsl_monte.h>
+
+#undef __BEGIN_DECLS
+#undef __END_DECLS
+#ifdef __cplusplus
+# define __BEGIN_DECLS extern "C" {
+# define __END_DECLS }
+#else
+# define __BEGIN_DECLS /* empty */
+# define __END_DECLS /* empty */
+#endif
+
+__BEGIN_DECLS
+
+/* Maximum number of points given to a function in one call */
+#define GSL_MONTE_BATCH2_BLOCK 256
+
+/* Writes values of function at n points to values[0..n-1].  Points are
+   given as struct of arrays, coordinate d of point i being
+   x[d * stride + i] with stride >= n. */
+typedef struct {
+  void (*f) (const double x[], size_t n, size_t stride, size_t dim,
+             void *params, double values[]);
+  size_t dim;
+  void *params;
+} gsl_monte_batch2_function;
+
+#define GSL_MONTE_BATCH2_EVAL(F,x,n,stride,values) \
+  (*((F)->f))(x, n, stride, (F)->dim, (F)->params, values)
+
+/* Parameters of batch function that evaluates a gsl_monte_function one
+   point at a time, x being space for coordinates of one point */
+typedef struct {
+  gsl_monte_function *f;
+  double *x;
+} gsl_monte_batch2_scalar;
+
+static inline void
+gsl_monte_batch2_scalar_eval (const double x[], size_t n, size_t stride,
+                              size_t dim, void *params, double values[])
+{
+  gsl_monte_batch2_scalar *scalar = (gsl_monte_batch2_scalar *) params;
+  size_t i, d;
+
+  for (i = 0; i < n; i++)
+    {
+      for (d = 0; d < dim; d++)
+        {
+          scalar->x[d] = x[d * stride + i];
+        }
+      values[i] = GSL_MONTE_FN_EVAL (scalar->f, scalar->x);
+    }
+}
+
+/* Makes batch a function that evaluates f one point at a time using
+   given space for dim coordinates, params of batch point to scalar */
+static inline void
+gsl_monte_batch2_from_scalar (gsl_monte_batch2_function * batch,
+                              gsl_monte_batch2_scalar * scalar,
+                              gsl_monte_function * f, double *x)
+{
+  scalar->f = f;
+  scalar->x = x;
+  batch->f = &gsl_monte_batch2_scalar_eval;
+  batch->dim = f->dim;
+  batch->params = scalar;
+}
+
+__END_DECLS
+
+#endif /* __GSL_MONTE_BATCH2_H__ */
@@ -28,6 +28,8 @@
 #include <gsl/gsl_monte.h>
 #include <gsl/gsl_monte_plain.h>
 #include <gsl/gsl_monte_miser.h>
+#include <gsl_monte_batch2.h>
+#include <gsl_monte_pool2.h>
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -48,6 +50,64 @@ int gsl_monte_miser_integrate2(gsl_monte_function * f,
                               gsl_monte_miser_state* state,
                               double *result, double *abserr, int* split_dims);
 
+/* Results of all integrations of a volume, for continuing its integration */
+typedef struct {
+  size_t calls;
+  double result;
+  double variance;
+} gsl_monte_miser2_sums;
+
+/* Same as above but combines result of calls new samples with those in
+   sums, weighted by number of samples, and returns the combined result.
+   Zero initialized sums have no samples. */
+int gsl_monte_miser_integrate2_continue(gsl_monte_function * f,
+                              const double xl[], const double xh[],
+                              size_t dim, size_t calls,
+                              gsl_rng *r,
+                              gsl_monte_miser_state* state,
+                              gsl_monte_miser2_sums* sums,
+                              double *result, double *abserr, int* split_dims);
+
+/* Same as above but evaluate f at blocks of points, the ones above
+   evaluate their function one point at a time through these */
+int gsl_monte_miser_integrate2_batch(const gsl_monte_batch2_function * f,
+                              const double xl[], const double xh[],
+                              size_t dim, size_t calls,
+                              gsl_rng *r,
+                              gsl_monte_miser_state* state,
+                              double *result, double *abserr, int* split_dims);
+
+int gsl_monte_miser_integrate2_batch_continue(const gsl_monte_batch2_function * f,
+                              const double xl[], const double xh[],
+                              size_t dim, size_t calls,
+                              gsl_rng *r,
+                              gsl_monte_miser_state* state,
+                              gsl_monte_miser2_sums* sums,
+                              double *result, double *abserr, int* split_dims);
+
+/* Same as batch versions above but halves of bisections are integrated
+   in tasks run by threads of pool, f being called from several threads at
+   once.  Halves with enough calls to be bisected again draw from
+   generators of their own, of the same type as r and seeded from the
+   generator of their parent, so results depend only on the state of r.
+   With a pool of one thread they are the same as from the ones above. */
+int gsl_monte_miser_integrate2_batch_threaded(const gsl_monte_batch2_function * f,
+                              const double xl[], const double xh[],
+                              size_t dim, size_t calls,
+                              gsl_rng *r,
+                              gsl_monte_pool2 *pool,
+                              gsl_monte_miser_state* state,
+                              double *result, double *abserr, int* split_dims);
+
+int gsl_monte_miser_integrate2_batch_threaded_continue(const gsl_monte_batch2_function * f,
+                              const double xl[], const double xh[],
+                              size_t dim, size_t calls,
+                              gsl_rng *r,
+                              gsl_monte_pool2 *pool,
+                              gsl_monte_miser_state* state,
+                              gsl_monte_miser2_sums* sums,
+                              double *result, double *abserr, int* split_dims);
+
 __END_DECLS
 
 #endif /* __GSL_MONTE_MISER2_H__ */
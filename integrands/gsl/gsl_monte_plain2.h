@@ -29,6 +29,8 @@
 #include <gsl/gsl_monte.h>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_monte_plain.h>
+#include <gsl_monte_batch2.h>
+#include <gsl_monte_pool2.h>
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -42,6 +44,41 @@
 
 __BEGIN_DECLS
 
+/* Sums over all samples taken in a volume, for continuing its integration */
+typedef struct {
+  size_t dim;
+  size_t calls;
+  double m;
+  double q;
+  double *quad_sums;
+  double *quad_sq;
+  size_t *quad_nr;
+} gsl_monte_plain2_sums;
+
+gsl_monte_plain2_sums* gsl_monte_plain2_sums_alloc (size_t dim);
+
+int gsl_monte_plain2_sums_init (gsl_monte_plain2_sums * sums);
+
+void gsl_monte_plain2_sums_free (gsl_monte_plain2_sums * sums);
+
+/* Adds samples in other to those in sums, both of same volume */
+void gsl_monte_plain2_sums_add (gsl_monte_plain2_sums * sums,
+                                const gsl_monte_plain2_sums * other);
+
+/* Estimates value and error of integral over lower and upper half of
+   volume from xl to xu along split_dim from samples in sums, in that
+   order in halves[0..3], or NaN for a half with fewer than 2 samples */
+void
+gsl_monte_plain2_halves (const gsl_monte_plain2_sums * sums,
+                         const double xl[], const double xu[],
+                         const size_t split_dim, double halves[]);
+
+/* Writes score of splitting volume along every dimension to scores[0..dim-1]
+   from samples in sums, the absolute difference between mean of samples in
+   lower and upper half, or 0 if either half has no samples */
+void
+gsl_monte_plain2_scores (const gsl_monte_plain2_sums * sums, double scores[]);
+
 int
 gsl_monte_plain_integrate2 (const gsl_monte_function * f,
                            const double xl[], const double xu[],
@@ -51,6 +88,55 @@ gsl_monte_plain_integrate2 (const gsl_monte_function * f,
                            gsl_monte_plain_state * state,
                            double *result, double *abserr, int* split_dims);
 
+/* Same as above but adds calls samples to those in sums and
+   returns result and abserr of all of them */
+int
+gsl_monte_plain_integrate2_continue (const gsl_monte_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims);
+
+/* Same as above but evaluates f at blocks of points, the ones above
+   evaluate their function one point at a time through this */
+int
+gsl_monte_plain_integrate2_batch (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           double *result, double *abserr, int* split_dims);
+
+int
+gsl_monte_plain_integrate2_batch_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims);
+
+/* Same as above but splits calls into as many parts as there are threads
+   in pool, part i being drawn with r[i] in some thread of pool and f being
+   called from several threads at once.  Samples of parts are added to sums
+   in order of parts so results depend only on states of r and size of pool,
+   with one thread they are the same as from the one above. */
+int
+gsl_monte_plain_integrate2_batch_threaded_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng ** r,
+                           gsl_monte_pool2 * pool,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims);
+
 __END_DECLS
 
 #endif /* __GSL_MONTE_PLAIN2_H__ */
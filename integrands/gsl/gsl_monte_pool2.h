@@ -0,0 +1,74 @@
+/* gsl_monte_pool2.h
+ *
+ * Copyright 2017 Ilja Honkonen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Threads that run tasks of the threaded integrate2 routines.  A pool
+   of size n has n - 1 threads of its own, the thread waiting for a task
+   runs queued tasks too so all n threads do work.  Tasks can spawn and
+   wait for tasks of their own.  Every thread queues tasks it spawns in
+   its own deque and runs the newest one of them first, threads without
+   tasks steal the oldest ones from other threads.  Only one thread from
+   outside the pool may use it at a time. */
+#ifndef __GSL_MONTE_POOL2_H__
+#define __GSL_MONTE_POOL2_H__
+
+#include <stddef.h>
+
+#undef __BEGIN_DECLS
+#undef __END_DECLS
+#ifdef __cplusplus
+# define __BEGIN_DECLS extern "C" {
+# define __END_DECLS }
+#else
+# define __BEGIN_DECLS /* empty */
+# define __END_DECLS /* empty */
+#endif
+
+__BEGIN_DECLS
+
+/* Runs run (arg) in some thread of pool, memory of task must stay valid
+   until it has been waited for */
+typedef struct gsl_monte_pool2_task {
+  void (*run) (void *arg);
+  void *arg;
+  /* used by pool */
+  int done;
+  struct gsl_monte_pool2_task *prev, *next;
+} gsl_monte_pool2_task;
+
+typedef struct gsl_monte_pool2 gsl_monte_pool2;
+
+/* Returns pool of given size or null if threads couldn't be started */
+gsl_monte_pool2 *gsl_monte_pool2_alloc (size_t size);
+
+/* Waits for threads of pool to finish their tasks and stops them */
+void gsl_monte_pool2_free (gsl_monte_pool2 * pool);
+
+size_t gsl_monte_pool2_size (const gsl_monte_pool2 * pool);
+
+/* Queues task to be run by pool */
+void gsl_monte_pool2_spawn (gsl_monte_pool2 * pool,
+                            gsl_monte_pool2_task * task);
+
+/* Runs queued tasks, newest of own first, until given one has finished */
+void gsl_monte_pool2_wait (gsl_monte_pool2 * pool,
+                           gsl_monte_pool2_task * task);
+
+__END_DECLS
+
+#endif /* __GSL_MONTE_POOL2_H__ */
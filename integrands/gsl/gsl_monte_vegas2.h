@@ -28,6 +28,7 @@
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_monte.h>
 #include <gsl/gsl_monte_vegas.h>
+#include <gsl_monte_batch2.h>
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -47,6 +48,31 @@ int gsl_monte_vegas_integrate2(gsl_monte_function * f,
                               gsl_rng * r,
                               gsl_monte_vegas_state *state,
                               double* result, double* abserr, int* split_dims);
+
+/* Same as above but adds calls samples to results of previous call with
+   state, which must have been for the same volume */
+int gsl_monte_vegas_integrate2_continue(gsl_monte_function * f,
+                              double xl[], double xu[],
+                              size_t dim, size_t calls,
+                              gsl_rng * r,
+                              gsl_monte_vegas_state *state,
+                              double* result, double* abserr, int* split_dims);
+
+/* Same as above but evaluate f at blocks of points, the ones above
+   evaluate their function one point at a time through these */
+int gsl_monte_vegas_integrate2_batch(const gsl_monte_batch2_function * f,
+                              double xl[], double xu[],
+                              size_t dim, size_t calls,
+                              gsl_rng * r,
+                              gsl_monte_vegas_state *state,
+                              double* result, double* abserr, int* split_dims);
+
+int gsl_monte_vegas_integrate2_batch_continue(const gsl_monte_batch2_function * f,
+                              double xl[], double xu[],
+                              size_t dim, size_t calls,
+                              gsl_rng * r,
+                              gsl_monte_vegas_state *state,
+                              double* result, double* abserr, int* split_dims);
 __END_DECLS
 
 #endif /* __GSL_MONTE_VEGAS2_H__ */
@@ -40,24 +40,108 @@
 #include <gsl/gsl_monte_miser.h>
 #include <gsl_monte_miser2.h>
 
+/* Space for a block of points as struct of arrays followed by their
+   values and squares of values */
+static double *
+alloc_block (size_t dim)
+{
+  return (double *) malloc ((dim + 2) * GSL_MONTE_BATCH2_BLOCK * sizeof (double));
+}
+
+/* Arrays used while integrating one subvolume, they can be reused by
+   subvolumes integrated after it by the same thread */
+typedef struct {
+  double *block_x;
+  double *xmid, *sigma_l, *sigma_r;
+  double *fsum_l, *fsum_r, *fsum2_l, *fsum2_r;
+  size_t *hits_l, *hits_r;
+} miser_scratch;
+
+/* Scratch with arrays of state, block_x must be freed */
 static int
-estimate_corrmc (gsl_monte_function * f,
+scratch_from_state (miser_scratch * scratch, gsl_monte_miser_state * state)
+{
+  scratch->block_x = alloc_block (state->dim);
+
+  if (scratch->block_x == 0)
+    {
+      GSL_ERROR ("failed to allocate space for block of points", GSL_ENOMEM);
+    }
+
+  scratch->xmid = state->xmid;
+  scratch->sigma_l = state->sigma_l;
+  scratch->sigma_r = state->sigma_r;
+  scratch->fsum_l = state->fsum_l;
+  scratch->fsum_r = state->fsum_r;
+  scratch->fsum2_l = state->fsum2_l;
+  scratch->fsum2_r = state->fsum2_r;
+  scratch->hits_l = state->hits_l;
+  scratch->hits_r = state->hits_r;
+
+  return GSL_SUCCESS;
+}
+
+/* Scratch of its own for a task, must be freed with free_scratch */
+static int
+alloc_scratch (miser_scratch * scratch, size_t dim)
+{
+  double *arrays;
+
+  scratch->block_x = alloc_block (dim);
+  arrays = (double *) malloc (7 * dim * sizeof (double));
+  scratch->hits_l = (size_t *) malloc (2 * dim * sizeof (size_t));
+
+  if (scratch->block_x == 0 || arrays == 0 || scratch->hits_l == 0)
+    {
+      free (scratch->block_x);
+      free (arrays);
+      free (scratch->hits_l);
+      GSL_ERROR ("failed to allocate space for task", GSL_ENOMEM);
+    }
+
+  scratch->xmid = arrays;
+  scratch->sigma_l = arrays + dim;
+  scratch->sigma_r = arrays + 2 * dim;
+  scratch->fsum_l = arrays + 3 * dim;
+  scratch->fsum_r = arrays + 4 * dim;
+  scratch->fsum2_l = arrays + 5 * dim;
+  scratch->fsum2_r = arrays + 6 * dim;
+  scratch->hits_r = scratch->hits_l + dim;
+
+  return GSL_SUCCESS;
+}
+
+static void
+free_scratch (miser_scratch * scratch)
+{
+  free (scratch->block_x);
+  free (scratch->xmid);
+  free (scratch->hits_l);
+}
+
+static int
+estimate_corrmc (const gsl_monte_batch2_function * f,
                  const double xl[], const double xu[],
                  size_t dim, size_t calls,
                  gsl_rng * r,
-                 gsl_monte_miser_state * state,
-                 double *result, double *abserr,
-                 const double xmid[], double sigma_l[], double sigma_r[])
+                 miser_scratch * scratch,
+                 double *result, double *abserr)
 {
-  size_t i, n;
-  
-  double *x = state->x;
-  double *fsum_l = state->fsum_l;
-  double *fsum_r = state->fsum_r;
-  double *fsum2_l = state->fsum2_l;
-  double *fsum2_r = state->fsum2_r;
-  size_t *hits_l = state->hits_l;
-  size_t *hits_r = state->hits_r;
+  size_t i, n, k, block;
+  const size_t stride = GSL_MONTE_BATCH2_BLOCK;
+  double *block_x = scratch->block_x;
+  double *fvals = block_x + dim * stride;
+  double *fvals2 = fvals + stride;
+
+  const double *xmid = scratch->xmid;
+  double *sigma_l = scratch->sigma_l;
+  double *sigma_r = scratch->sigma_r;
+  double *fsum_l = scratch->fsum_l;
+  double *fsum_r = scratch->fsum_r;
+  double *fsum2_l = scratch->fsum2_l;
+  double *fsum2_r = scratch->fsum2_r;
+  size_t *hits_l = scratch->hits_l;
+  size_t *hits_r = scratch->hits_r;
 
   double m = 0.0, q = 0.0; 
   double vol = 1.0;
@@ -71,58 +155,81 @@ estimate_corrmc (gsl_monte_function * f,
       sigma_l[i] = sigma_r[i] = -1;
     }
 
-  for (n = 0; n < calls; n++)
+  for (n = 0; n < calls; n += block)
     {
-      double fval;
-      
-      unsigned int j = (n/2) % dim;
-      unsigned int side = (n % 2);
+      block = GSL_MIN (stride, calls - n);
 
-      for (i = 0; i < dim; i++)
+      for (k = 0; k < block; k++)
         {
-          double z = gsl_rng_uniform_pos (r) ;
+          unsigned int j = ((n + k)/2) % dim;
+          unsigned int side = ((n + k) % 2);
 
-          if (i != j) 
-            {
-              x[i] = xl[i] + z * (xu[i] - xl[i]);
-            }
-          else
+          for (i = 0; i < dim; i++)
             {
-              if (side == 0) 
+              double z = gsl_rng_uniform_pos (r) ;
+
+              if (i != j) 
                 {
-                  x[i] = xmid[i] + z * (xu[i] - xmid[i]);
+                  block_x[i * stride + k] = xl[i] + z * (xu[i] - xl[i]);
                 }
               else
                 {
-                  x[i] = xl[i] + z * (xmid[i] - xl[i]);
+                  if (side == 0) 
+                    {
+                      block_x[i * stride + k] = xmid[i] + z * (xu[i] - xmid[i]);
+                    }
+                  else
+                    {
+                      block_x[i * stride + k] = xl[i] + z * (xmid[i] - xl[i]);
+                    }
                 }
             }
         }
 
-      fval = GSL_MONTE_FN_EVAL (f, x);
+      GSL_MONTE_BATCH2_EVAL (f, block_x, block, stride, fvals);
 
       /* recurrence for mean and variance */
-      {
-        double d = fval - m;
-        m += d / (n + 1.0);
-        q += d * d * (n / (n + 1.0));
-      }
+      for (k = 0; k < block; k++)
+        {
+          double d = fvals[k] - m;
+          m += d / (n + k + 1.0);
+          q += d * d * ((n + k) / (n + k + 1.0));
+        }
 
-      /* compute the variances on each side of the bisection */
+      for (k = 0; k < block; k++)
+        {
+          fvals2[k] = fvals[k] * fvals[k];
+        }
+
+      /* compute the variances on each side of the bisection, without
+         branches on side of points since it's random.  Adding zero
+         to the other side doesn't change its sum which starts from +0
+         so sums are the same as when adding to one side only. */
       for (i = 0; i < dim; i++)
         {
-          if (x[i] <= xmid[i])
-            {
-              fsum_l[i] += fval;
-              fsum2_l[i] += fval * fval;
-              hits_l[i]++;
-            }
-          else
+          const double *xi = block_x + i * stride;
+          const double xmid_i = xmid[i];
+          double sum_l = fsum_l[i], sum_r = fsum_r[i];
+          double sum2_l = fsum2_l[i], sum2_r = fsum2_r[i];
+          size_t hits = 0;
+
+          for (k = 0; k < block; k++)
             {
-              fsum_r[i] += fval;
-              fsum2_r[i] += fval * fval;
-              hits_r[i]++;
+              const int left = xi[k] <= xmid_i;
+
+              sum_l += left ? fvals[k] : 0.0;
+              sum_r += left ? 0.0 : fvals[k];
+              sum2_l += left ? fvals2[k] : 0.0;
+              sum2_r += left ? 0.0 : fvals2[k];
+              hits += left;
             }
+
+          fsum_l[i] = sum_l;
+          fsum_r[i] = sum_r;
+          fsum2_l[i] = sum2_l;
+          fsum2_r[i] = sum2_r;
+          hits_l[i] += hits;
+          hits_r[i] += block - hits;
         }
     }
 
@@ -159,15 +266,202 @@ estimate_corrmc (gsl_monte_function * f,
   return GSL_SUCCESS;
 }
 
-int
-gsl_monte_miser_integrate2 (gsl_monte_function * f,
-                           const double xl[], const double xu[],
-                           size_t dim, size_t calls,
-                           gsl_rng * r,
-                           gsl_monte_miser_state * state,
-                           double *result, double *abserr, int* split_dims)
+static int
+miser_integrate (const gsl_monte_batch2_function * f,
+                 const double xl[], const double xu[],
+                 size_t dim, size_t calls,
+                 gsl_rng * r,
+                 gsl_monte_pool2 * pool,
+                 const gsl_monte_miser_state * state,
+                 miser_scratch * scratch,
+                 double *result, double *abserr, int* split_dims);
+
+/* One half of a bisection integrated in a task of its own, with its own
+   generator and split_dims added to those of parent after the task */
+typedef struct {
+  gsl_monte_pool2_task task;
+  const gsl_monte_batch2_function *f;
+  double *xl, *xu;
+  size_t dim, calls;
+  gsl_rng *r;
+  gsl_monte_pool2 *pool;
+  const gsl_monte_miser_state *state;
+  int *split_dims;
+  double result, abserr;
+  int status;
+} miser_half;
+
+static void
+run_half (void *arg)
+{
+  miser_half *half = (miser_half *) arg;
+  miser_scratch scratch;
+
+  half->status = alloc_scratch (&scratch, half->dim);
+  if (half->status != GSL_SUCCESS)
+    {
+      return;
+    }
+
+  half->status = miser_integrate (half->f, half->xl, half->xu, half->dim,
+                                  half->calls, half->r, half->pool,
+                                  half->state, &scratch, &half->result,
+                                  &half->abserr, half->split_dims);
+  free_scratch (&scratch);
+}
+
+/* Returns half with copies of xl and xu and generator seeded with seed */
+static miser_half *
+alloc_half (const gsl_monte_batch2_function * f,
+            const double xl[], const double xu[],
+            size_t dim, size_t calls,
+            const gsl_rng * r, unsigned long seed,
+            gsl_monte_pool2 * pool,
+            const gsl_monte_miser_state * state)
+{
+  size_t i;
+  miser_half *half = (miser_half *) calloc (1, sizeof (miser_half));
+
+  if (half == 0)
+    {
+      return 0;
+    }
+
+  half->xl = (double *) malloc (2 * dim * sizeof (double));
+  half->split_dims = (int *) calloc (dim, sizeof (int));
+  half->r = gsl_rng_alloc (r->type);
+
+  if (half->xl == 0 || half->split_dims == 0 || half->r == 0)
+    {
+      free (half->xl);
+      free (half->split_dims);
+      if (half->r != 0)
+        {
+          gsl_rng_free (half->r);
+        }
+      free (half);
+      return 0;
+    }
+
+  half->xu = half->xl + dim;
+  for (i = 0; i < dim; i++)
+    {
+      half->xl[i] = xl[i];
+      half->xu[i] = xu[i];
+    }
+
+  gsl_rng_set (half->r, seed);
+  half->task.run = &run_half;
+  half->task.arg = half;
+  half->f = f;
+  half->dim = dim;
+  half->calls = calls;
+  half->pool = pool;
+  half->state = state;
+
+  return half;
+}
+
+static void
+free_half (miser_half * half)
+{
+  gsl_rng_free (half->r);
+  free (half->split_dims);
+  free (half->xl);
+  free (half);
+}
+
+/* Integrates left half of bisection at xbi_m of dimension i_bisect in a
+   new task and right half in this one */
+static int
+bisect_in_tasks (const gsl_monte_batch2_function * f,
+                 const double xl[], const double xu[],
+                 size_t dim, size_t i_bisect, double xbi_m,
+                 size_t calls_l, size_t calls_r,
+                 gsl_rng * r,
+                 gsl_monte_pool2 * pool,
+                 const gsl_monte_miser_state * state,
+                 miser_scratch * scratch,
+                 double *result, double *abserr, int* split_dims)
+{
+  int status;
+  size_t i;
+  double res_r = 0, err_r = 0;
+  double *xl_tmp;
+
+  miser_half *left = alloc_half (f, xl, xu, dim, calls_l, r, gsl_rng_get (r),
+                                 pool, state);
+
+  if (left == 0)
+    {
+      GSL_ERROR ("out of memory for left task", GSL_ENOMEM);
+    }
+
+  left->xu[i_bisect] = xbi_m;
+  gsl_monte_pool2_spawn (pool, &left->task);
+
+  xl_tmp = (double *) malloc (dim * sizeof (double));
+
+  if (xl_tmp == 0)
+    {
+      gsl_error ("out of memory for right workspace", __FILE__, __LINE__,
+                 GSL_ENOMEM);
+      status = GSL_ENOMEM;
+    }
+  else
+    {
+      for (i = 0; i < dim; i++)
+        {
+          xl_tmp[i] = xl[i];
+        }
+
+      xl_tmp[i_bisect] = xbi_m;
+
+      status = miser_integrate (f, xl_tmp, xu, dim, calls_r, r, pool, state,
+                                scratch, &res_r, &err_r, split_dims);
+      free (xl_tmp);
+    }
+
+  /* left task uses memory of left so wait for it even after an error */
+
+  gsl_monte_pool2_wait (pool, &left->task);
+
+  if (status == GSL_SUCCESS)
+    {
+      status = left->status;
+    }
+
+  if (status == GSL_SUCCESS)
+    {
+      for (i = 0; i < dim; i++)
+        {
+          split_dims[i] += left->split_dims[i];
+        }
+
+      *result = left->result + res_r;
+      *abserr = sqrt (left->abserr * left->abserr + err_r * err_r);
+    }
+
+  free_half (left);
+
+  return status;
+}
+
+/* Integrates with MISER using given scratch.  With a pool halves of
+   bisections that will be bisected again are integrated in tasks of their
+   own with generators seeded from r of parent, so results depend only on
+   state of r and not on which threads run the tasks. */
+static int
+miser_integrate (const gsl_monte_batch2_function * f,
+                 const double xl[], const double xu[],
+                 size_t dim, size_t calls,
+                 gsl_rng * r,
+                 gsl_monte_pool2 * pool,
+                 const gsl_monte_miser_state * state,
+                 miser_scratch * scratch,
+                 double *result, double *abserr, int* split_dims)
 {
-  size_t n, estimate_calls, calls_l, calls_r;
+  size_t n, k, block, estimate_calls, calls_l, calls_r;
   const size_t min_calls = state->min_calls;
   size_t i;
   size_t i_bisect;
@@ -180,9 +474,10 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
   double vol;
   double weight_l, weight_r;
 
-  double *x = state->x;
-  double *xmid = state->xmid;
-  double *sigma_l = state->sigma_l, *sigma_r = state->sigma_r;
+  const size_t stride = GSL_MONTE_BATCH2_BLOCK;
+  double *block_x = scratch->block_x;
+  double *xmid = scratch->xmid;
+  double *sigma_l = scratch->sigma_l, *sigma_r = scratch->sigma_r;
 
   if (dim != state->dim)
     {
@@ -226,24 +521,33 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
           GSL_ERROR ("insufficient calls for subvolume", GSL_EFAILED);
         }
 
-      for (n = 0; n < calls; n++)
+      for (n = 0; n < calls; n += block)
         {
-          /* Choose a random point in the integration region */
+          double *fvals = block_x + dim * stride;
 
-          for (i = 0; i < dim; i++)
+          block = GSL_MIN (stride, calls - n);
+
+          /* Choose random points in the integration region */
+
+          for (k = 0; k < block; k++)
             {
-              x[i] = xl[i] + gsl_rng_uniform_pos (r) * (xu[i] - xl[i]);
+              for (i = 0; i < dim; i++)
+                {
+                  block_x[i * stride + k]
+                    = xl[i] + gsl_rng_uniform_pos (r) * (xu[i] - xl[i]);
+                }
             }
 
-          {
-            double fval = GSL_MONTE_FN_EVAL (f, x);
+          GSL_MONTE_BATCH2_EVAL (f, block_x, block, stride, fvals);
 
-            /* recurrence for mean and variance */
+          /* recurrence for mean and variance */
 
-            double d = fval - m;
-            m += d / (n + 1.0);
-            q += d * d * (n / (n + 1.0));
-          }
+          for (k = 0; k < block; k++)
+            {
+              double d = fvals[k] - m;
+              m += d / (n + k + 1.0);
+              q += d * d * ((n + k) / (n + k + 1.0));
+            }
         }
 
       *result = vol * m;
@@ -265,7 +569,7 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
   for (i = 0; i < dim; i++)
     {
       s = (gsl_rng_uniform (r) - 0.5) >= 0.0 ? state->dither : -state->dither;
-      state->xmid[i] = (0.5 + s) * xl[i] + (0.5 - s) * xu[i];
+      xmid[i] = (0.5 + s) * xl[i] + (0.5 - s) * xu[i];
     }
 
   /* The idea is to chose the direction to bisect based on which will
@@ -275,7 +579,7 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
      for each half-region for each bisection. */
 
   estimate_corrmc (f, xl, xu, dim, estimate_calls,
-                   r, state, &res_est, &err_est, xmid, sigma_l, sigma_r);
+                   r, scratch, &res_est, &err_est);
 
   /* We have now used up some calls for the estimation */
 
@@ -353,6 +657,13 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
     calls_r = min_calls + (calls - 2 * min_calls) * b / (a + b);
   }
 
+  if (pool != 0 && calls_l >= state->min_calls_per_bisection)
+    {
+      return bisect_in_tasks (f, xl, xu, dim, i_bisect, xbi_m,
+                              calls_l, calls_r, r, pool, state, scratch,
+                              result, abserr, split_dims);
+    }
+
   /* Compute the integral for the left hand side of the bisection */
 
   /* Due to the recursive nature of the algorithm we must allocate
@@ -375,9 +686,9 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
 
     xu_tmp[i_bisect] = xbi_m;
 
-    status = gsl_monte_miser_integrate2 (f, xl, xu_tmp,
-                                        dim, calls_l, r, state,
-                                        &res_l, &err_l, split_dims);
+    status = miser_integrate (f, xl, xu_tmp,
+                              dim, calls_l, r, pool, state, scratch,
+                              &res_l, &err_l, split_dims);
     free (xu_tmp);
 
     if (status != GSL_SUCCESS)
@@ -405,9 +716,9 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
 
     xl_tmp[i_bisect] = xbi_m;
 
-    status = gsl_monte_miser_integrate2 (f, xl_tmp, xu,
-                                        dim, calls_r, r, state,
-                                        &res_r, &err_r, split_dims);
+    status = miser_integrate (f, xl_tmp, xu,
+                              dim, calls_r, r, pool, state, scratch,
+                              &res_r, &err_r, split_dims);
     free (xl_tmp);
 
     if (status != GSL_SUCCESS)
@@ -421,3 +732,173 @@ gsl_monte_miser_integrate2 (gsl_monte_function * f,
 
   return GSL_SUCCESS;
 }
+
+/* Integrates with threads of pool or without threads if pool is null */
+static int
+integrate (const gsl_monte_batch2_function * f,
+           const double xl[], const double xu[],
+           size_t dim, size_t calls,
+           gsl_rng * r,
+           gsl_monte_pool2 * pool,
+           gsl_monte_miser_state * state,
+           double *result, double *abserr, int* split_dims)
+{
+  int status;
+  miser_scratch scratch;
+
+  if (dim != state->dim)
+    {
+      GSL_ERROR ("number of dimensions must match allocated size", GSL_EINVAL);
+    }
+
+  status = scratch_from_state (&scratch, state);
+  if (status != GSL_SUCCESS)
+    {
+      return status;
+    }
+
+  status = miser_integrate (f, xl, xu, dim, calls, r, pool, state, &scratch,
+                            result, abserr, split_dims);
+  free (scratch.block_x);
+
+  return status;
+}
+
+/* Combines result of calls new samples with sums */
+static void
+add_result (gsl_monte_miser2_sums * sums, size_t calls,
+            double res, double err,
+            double *result, double *abserr)
+{
+  size_t total_calls = sums->calls + calls;
+
+  /* independent stratified estimates can't be merged sample by sample
+     so weigh them by their number of samples */
+  double w_old = (double) sums->calls / total_calls;
+  double w_new = (double) calls / total_calls;
+
+  sums->result = w_old * sums->result + w_new * res;
+  sums->variance = w_old * w_old * sums->variance + w_new * w_new * err * err;
+  sums->calls = total_calls;
+
+  *result = sums->result;
+  *abserr = sqrt (sums->variance);
+}
+
+int
+gsl_monte_miser_integrate2_batch (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_miser_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  return integrate (f, xl, xu, dim, calls, r, 0, state,
+                    result, abserr, split_dims);
+}
+
+int
+gsl_monte_miser_integrate2 (gsl_monte_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_miser_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, f, state->x);
+  return gsl_monte_miser_integrate2_batch (&batch, xl, xu, dim, calls, r,
+                                           state, result, abserr,
+                                           split_dims);
+}
+
+int
+gsl_monte_miser_integrate2_continue (gsl_monte_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_miser_state * state,
+                           gsl_monte_miser2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, f, state->x);
+  return gsl_monte_miser_integrate2_batch_continue (&batch, xl, xu, dim,
+                                                    calls, r, state, sums,
+                                                    result, abserr,
+                                                    split_dims);
+}
+
+int
+gsl_monte_miser_integrate2_batch_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_miser_state * state,
+                           gsl_monte_miser2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  double res, err;
+
+  int status = gsl_monte_miser_integrate2_batch (f, xl, xu, dim, calls, r,
+                                                 state, &res, &err,
+                                                 split_dims);
+
+  if (status != GSL_SUCCESS)
+    {
+      return status;
+    }
+
+  add_result (sums, calls, res, err, result, abserr);
+
+  return GSL_SUCCESS;
+}
+
+int
+gsl_monte_miser_integrate2_batch_threaded (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_pool2 * pool,
+                           gsl_monte_miser_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  if (gsl_monte_pool2_size (pool) == 1)
+    {
+      pool = 0;
+    }
+
+  return integrate (f, xl, xu, dim, calls, r, pool, state,
+                    result, abserr, split_dims);
+}
+
+int
+gsl_monte_miser_integrate2_batch_threaded_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_pool2 * pool,
+                           gsl_monte_miser_state * state,
+                           gsl_monte_miser2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  double res, err;
+
+  int status = gsl_monte_miser_integrate2_batch_threaded (f, xl, xu, dim,
+                                                          calls, r, pool,
+                                                          state, &res, &err,
+                                                          split_dims);
+
+  if (status != GSL_SUCCESS)
+    {
+      return status;
+    }
+
+  add_result (sums, calls, res, err, result, abserr);
+
+  return GSL_SUCCESS;
+}
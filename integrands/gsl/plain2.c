@@ -23,10 +23,158 @@
 /* Author: MJB */
 /* Modified by IH to return a suggested split dimension for hdintegrator */
 #include <math.h>
+#include <stdlib.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_monte_plain.h>
 #include <gsl_monte_plain2.h>
+#include <gsl_monte_pool2.h>
+
+gsl_monte_plain2_sums*
+gsl_monte_plain2_sums_alloc (size_t dim)
+{
+  gsl_monte_plain2_sums *sums
+    = (gsl_monte_plain2_sums *) malloc (sizeof (gsl_monte_plain2_sums));
+
+  if (sums == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for sums struct",
+                     GSL_ENOMEM, 0);
+    }
+
+  sums->quad_sums = (double *) malloc (2 * dim * sizeof (double));
+  sums->quad_sq = (double *) malloc (2 * dim * sizeof (double));
+  sums->quad_nr = (size_t *) malloc (2 * dim * sizeof (size_t));
+
+  if (sums->quad_sums == 0 || sums->quad_sq == 0 || sums->quad_nr == 0)
+    {
+      free (sums->quad_sums);
+      free (sums->quad_sq);
+      free (sums->quad_nr);
+      free (sums);
+      GSL_ERROR_VAL ("failed to allocate space for sums", GSL_ENOMEM, 0);
+    }
+
+  sums->dim = dim;
+  gsl_monte_plain2_sums_init (sums);
+
+  return sums;
+}
+
+int
+gsl_monte_plain2_sums_init (gsl_monte_plain2_sums * sums)
+{
+  size_t i;
+
+  sums->calls = 0;
+  sums->m = 0;
+  sums->q = 0;
+
+  for (i = 0; i < 2 * sums->dim; i++)
+    {
+      sums->quad_sums[i] = 0;
+      sums->quad_sq[i] = 0;
+      sums->quad_nr[i] = 0;
+    }
+
+  return GSL_SUCCESS;
+}
+
+void
+gsl_monte_plain2_sums_free (gsl_monte_plain2_sums * sums)
+{
+  if (sums == 0)
+    {
+      return;
+    }
+  free (sums->quad_sums);
+  free (sums->quad_sq);
+  free (sums->quad_nr);
+  free (sums);
+}
+
+void
+gsl_monte_plain2_sums_add (gsl_monte_plain2_sums * sums,
+                           const gsl_monte_plain2_sums * other)
+{
+  const size_t n_a = sums->calls, n_b = other->calls, n = n_a + n_b;
+  size_t i;
+
+  if (n_b == 0)
+    {
+      return;
+    }
+
+  /* combine means and sums of squared differences from them */
+  {
+    const double d = other->m - sums->m;
+    sums->m += d * ((double) n_b / n);
+    sums->q += other->q + d * d * ((double) n_a * n_b / n);
+  }
+  sums->calls = n;
+
+  for (i = 0; i < 2 * sums->dim; i++)
+    {
+      sums->quad_sums[i] += other->quad_sums[i];
+      sums->quad_sq[i] += other->quad_sq[i];
+      sums->quad_nr[i] += other->quad_nr[i];
+    }
+}
+
+void
+gsl_monte_plain2_halves (const gsl_monte_plain2_sums * sums,
+                         const double xl[], const double xu[],
+                         const size_t split_dim, double halves[])
+{
+  double half_vol = 0.5;
+  size_t i;
+
+  for (i = 0; i < sums->dim; i++)
+    {
+      half_vol *= xu[i] - xl[i];
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      const double n = sums->quad_nr[2 * split_dim + i];
+      const double sum = sums->quad_sums[2 * split_dim + i];
+      const double sq = sums->quad_sq[2 * split_dim + i];
+
+      if (n < 2)
+        {
+          halves[2 * i] = GSL_NAN;
+          halves[2 * i + 1] = GSL_NAN;
+          continue;
+        }
+
+      /* mean and error of mean of samples that fell into the half */
+      halves[2 * i] = half_vol * sum / n;
+      halves[2 * i + 1]
+        = half_vol * sqrt (GSL_MAX (0.0, sq - sum * sum / n) / (n * (n - 1)));
+    }
+}
+
+void
+gsl_monte_plain2_scores (const gsl_monte_plain2_sums * sums, double scores[])
+{
+  size_t d;
+
+  for (d = 0; d < sums->dim; d++)
+    {
+      const size_t n_lower = sums->quad_nr[2 * d];
+      const size_t n_upper = sums->quad_nr[2 * d + 1];
+
+      if (n_lower == 0 || n_upper == 0)
+        {
+          scores[d] = 0;
+          continue;
+        }
+
+      /* same difference of means as used for choosing split dimension */
+      scores[d] = fabs (sums->quad_sums[2 * d] / n_lower
+                        - sums->quad_sums[2 * d + 1] / n_upper);
+    }
+}
 
 int
 gsl_monte_plain_integrate2 (const gsl_monte_function * f,
@@ -37,11 +185,71 @@ gsl_monte_plain_integrate2 (const gsl_monte_function * f,
                            gsl_monte_plain_state * state,
                            double *result, double *abserr, int* split_dims)
 {
-  double vol, m = 0, q = 0;
-  double *x = state->x;
-  size_t n, i;
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, (gsl_monte_function *) f,
+                                state->x);
+  return gsl_monte_plain_integrate2_batch (&batch, xl, xu, dim, calls, r,
+                                           state, result, abserr,
+                                           split_dims);
+}
+
+int
+gsl_monte_plain_integrate2_continue (const gsl_monte_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, (gsl_monte_function *) f,
+                                state->x);
+  return gsl_monte_plain_integrate2_batch_continue (&batch, xl, xu, dim,
+                                                    calls, r, state, sums,
+                                                    result, abserr,
+                                                    split_dims);
+}
 
-  if (dim != state->dim)
+int
+gsl_monte_plain_integrate2_batch (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  int status;
+  gsl_monte_plain2_sums *sums = gsl_monte_plain2_sums_alloc (dim);
+
+  if (sums == 0)
+    {
+      return GSL_ENOMEM;
+    }
+
+  status = gsl_monte_plain_integrate2_batch_continue (f, xl, xu, dim, calls,
+                                                      r, state, sums, result,
+                                                      abserr, split_dims);
+  gsl_monte_plain2_sums_free (sums);
+
+  return status;
+}
+
+/* Checks that sums and state are for dim dimensions and extents are valid */
+static int
+check_extents (const double xl[], const double xu[], const size_t dim,
+               const gsl_monte_plain_state * state,
+               const gsl_monte_plain2_sums * sums)
+{
+  size_t i;
+
+  if (dim != state->dim || dim != sums->dim)
     {
       GSL_ERROR ("number of dimensions must match allocated size", GSL_EINVAL);
     }
@@ -60,74 +268,266 @@ gsl_monte_plain_integrate2 (const gsl_monte_function * f,
         }
     }
 
-  /* Compute the volume of the region */
+  return GSL_SUCCESS;
+}
 
-  vol = 1;
+/* Adds calls samples drawn with r to sums */
+static int
+add_samples (const gsl_monte_batch2_function * f,
+             const double xl[], const double xu[],
+             const size_t dim, const size_t calls,
+             gsl_rng * r, gsl_monte_plain2_sums * sums)
+{
+  double m = sums->m, q = sums->q;
+  double *x, *fvals;
+  double *quad_avgs = sums->quad_sums;
+  double *quad_sq = sums->quad_sq;
+  size_t *quad_nr = sums->quad_nr;
+  size_t n, i, block;
+  const size_t stride = GSL_MONTE_BATCH2_BLOCK;
 
-  for (i = 0; i < dim; i++)
+  /* Points of a block as struct of arrays followed by their values */
+
+  x = (double *) malloc ((dim + 1) * stride * sizeof (double));
+
+  if (x == 0)
     {
-      vol *= xu[i] - xl[i];
+      GSL_ERROR ("failed to allocate space for block of points", GSL_ENOMEM);
     }
 
-  double* quad_avgs = (double*) calloc(2*dim, sizeof(double));
-  int* quad_nr = (int*) calloc(2*dim, sizeof(int));
-  if (quad_avgs == NULL || quad_nr == NULL) {
-    return GSL_FAILURE;
-  }
+  fvals = x + dim * stride;
 
-  for (n = 0; n < calls; n++)
+  for (n = sums->calls; n < sums->calls + calls; n += block)
     {
-      /* Choose a random point in the integration region */
+      block = GSL_MIN (stride, sums->calls + calls - n);
+
+      /* Choose random points in the integration region, in the same
+         order as one point at a time */
 
-      for (i = 0; i < dim; i++)
+      for (size_t k = 0; k < block; k++)
         {
-          x[i] = xl[i] + gsl_rng_uniform_pos (r) * (xu[i] - xl[i]);
+          for (i = 0; i < dim; i++)
+            {
+              x[i * stride + k]
+                = xl[i] + gsl_rng_uniform_pos (r) * (xu[i] - xl[i]);
+            }
         }
 
-      {
-        double fval = GSL_MONTE_FN_EVAL (f, x);
+      GSL_MONTE_BATCH2_EVAL (f, x, block, stride, fvals);
 
-        for (unsigned int d = 0; d < dim; d++) {
-          if (x[d] - xl[d] < xu[d] - x[d]) {
-            quad_avgs[d] += fval;
-            quad_nr[d]++;
+      for (unsigned int d = 0; d < dim; d++) {
+        const double *xd = x + d * stride;
+        for (size_t k = 0; k < block; k++) {
+          const double fval = fvals[k];
+          if (xd[k] - xl[d] < xu[d] - xd[k]) {
+            quad_avgs[2*d] += fval;
+            quad_sq[2*d] += fval * fval;
+            quad_nr[2*d]++;
           } else {
-            quad_avgs[d+1] += fval;
-            quad_nr[d+1]++;
+            quad_avgs[2*d+1] += fval;
+            quad_sq[2*d+1] += fval * fval;
+            quad_nr[2*d+1]++;
           }
         }
+      }
 
-        /* recurrence for mean and variance */
+      /* recurrence for mean and variance */
 
-        double d = fval - m;
-        m += d / (n + 1.0);
-        q += d * d * (n / (n + 1.0));
-      }
+      for (size_t k = 0; k < block; k++)
+        {
+          double d = fvals[k] - m;
+          m += d / (n + k + 1.0);
+          q += d * d * ((n + k) / (n + k + 1.0));
+        }
     }
 
-  *result = vol * m;
+  free (x);
+
+  sums->calls += calls;
+  sums->m = m;
+  sums->q = q;
+
+  return GSL_SUCCESS;
+}
+
+/* Writes value and error of integral over volume from xl to xu from
+   samples in sums and increments suggested split dimension */
+static void
+finish (const gsl_monte_plain2_sums * sums,
+        const double xl[], const double xu[],
+        double *result, double *abserr, int *split_dims)
+{
+  const size_t dim = sums->dim, total_calls = sums->calls;
+  const double *quad_avgs = sums->quad_sums;
+  const size_t *quad_nr = sums->quad_nr;
+  double vol;
+  size_t i;
+
+  /* Compute the volume of the region */
 
-  if (calls < 2)
+  vol = 1;
+
+  for (i = 0; i < dim; i++)
+    {
+      vol *= xu[i] - xl[i];
+    }
+
+  *result = vol * sums->m;
+
+  if (total_calls < 2)
     {
       *abserr = GSL_POSINF;
     }
   else
     {
-      *abserr = vol * sqrt (q / (calls * (calls - 1.0)));
+      *abserr = vol * sqrt (sums->q / (total_calls * (total_calls - 1.0)));
     }
 
   double max_diff = -1;
   int max_diff_d = 0;
   for (size_t d = 0; d < dim; d++) {
-    quad_avgs[d] /= quad_nr[d];
-    quad_avgs[d+1] /= quad_nr[d+1];
-    const double diff = abs(quad_avgs[d] - quad_avgs[d+1]);
+    const double diff = fabs(quad_avgs[2*d] / quad_nr[2*d] - quad_avgs[2*d+1] / quad_nr[2*d+1]);
     if (max_diff < diff) {
       max_diff = diff;
       max_diff_d = d;
     }
   }
   (*(split_dims + max_diff_d))++;
+}
 
-  return GSL_SUCCESS;
+int
+gsl_monte_plain_integrate2_batch_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  int status = check_extents (xl, xu, dim, state, sums);
+
+  if (status == GSL_SUCCESS)
+    {
+      status = add_samples (f, xl, xu, dim, calls, r, sums);
+    }
+
+  if (status == GSL_SUCCESS)
+    {
+      finish (sums, xl, xu, result, abserr, split_dims);
+    }
+
+  return status;
+}
+
+/* Samples taken by one thread in gsl_monte_plain_integrate2_batch_threaded_continue */
+typedef struct {
+  gsl_monte_pool2_task task;
+  const gsl_monte_batch2_function *f;
+  const double *xl, *xu;
+  size_t calls;
+  gsl_rng *r;
+  gsl_monte_plain2_sums *sums;
+  int status;
+} plain2_part;
+
+static void
+run_part (void *arg)
+{
+  plain2_part *part = (plain2_part *) arg;
+
+  part->status = add_samples (part->f, part->xl, part->xu, part->sums->dim,
+                              part->calls, part->r, part->sums);
+}
+
+int
+gsl_monte_plain_integrate2_batch_threaded_continue (const gsl_monte_batch2_function * f,
+                           const double xl[], const double xu[],
+                           const size_t dim,
+                           const size_t calls,
+                           gsl_rng ** r,
+                           gsl_monte_pool2 * pool,
+                           gsl_monte_plain_state * state,
+                           gsl_monte_plain2_sums * sums,
+                           double *result, double *abserr, int* split_dims)
+{
+  const size_t nr_parts = gsl_monte_pool2_size (pool);
+  plain2_part *parts;
+  size_t i;
+  int status;
+
+  if (nr_parts == 1)
+    {
+      return gsl_monte_plain_integrate2_batch_continue (f, xl, xu, dim, calls,
+                                                        r[0], state, sums,
+                                                        result, abserr,
+                                                        split_dims);
+    }
+
+  status = check_extents (xl, xu, dim, state, sums);
+  if (status != GSL_SUCCESS)
+    {
+      return status;
+    }
+
+  parts = (plain2_part *) calloc (nr_parts, sizeof (plain2_part));
+  if (parts == 0)
+    {
+      GSL_ERROR ("failed to allocate space for parts", GSL_ENOMEM);
+    }
+
+  for (i = 0; i < nr_parts; i++)
+    {
+      parts[i].sums = gsl_monte_plain2_sums_alloc (dim);
+      if (parts[i].sums == 0)
+        {
+          status = GSL_ENOMEM;
+          break;
+        }
+    }
+
+  /* part i draws its share of calls with r[i] */
+
+  if (status == GSL_SUCCESS)
+    {
+      for (i = 0; i < nr_parts; i++)
+        {
+          parts[i].task.run = &run_part;
+          parts[i].task.arg = &parts[i];
+          parts[i].f = f;
+          parts[i].xl = xl;
+          parts[i].xu = xu;
+          parts[i].calls = calls / nr_parts + (i < calls % nr_parts ? 1 : 0);
+          parts[i].r = r[i];
+          gsl_monte_pool2_spawn (pool, &parts[i].task);
+        }
+
+      for (i = 0; i < nr_parts; i++)
+        {
+          gsl_monte_pool2_wait (pool, &parts[i].task);
+          if (parts[i].status != GSL_SUCCESS)
+            {
+              status = parts[i].status;
+            }
+        }
+    }
+
+  /* merge in order of parts so result doesn't depend on scheduling */
+
+  if (status == GSL_SUCCESS)
+    {
+      for (i = 0; i < nr_parts; i++)
+        {
+          gsl_monte_plain2_sums_add (sums, parts[i].sums);
+        }
+      finish (sums, xl, xu, result, abserr, split_dims);
+    }
+
+  for (i = 0; i < nr_parts; i++)
+    {
+      gsl_monte_plain2_sums_free (parts[i].sums);
+    }
+  free (parts);
+
+  return status;
 }
@@ -0,0 +1,290 @@
+/* monte/pool2.c
+ *
+ * Copyright 2017 Ilja Honkonen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Work-stealing thread pool for threaded integrate2 routines, see
+   gsl_monte_pool2.h.  Thread i of pool owns deques[i], the thread from
+   outside the pool uses deques[0].  Deques are guarded by the mutex of
+   pool since tasks run long compared to queuing them. */
+#include <pthread.h>
+#include <stdlib.h>
+#include <gsl_monte_pool2.h>
+
+/* Queued tasks of one thread linked from oldest (top) to newest (bottom) */
+typedef struct {
+  gsl_monte_pool2_task *top, *bottom;
+} task_deque;
+
+struct gsl_monte_pool2 {
+  size_t size;
+  size_t nr_threads;
+  size_t nr_started;
+  pthread_t *threads;
+  task_deque *deques;
+  pthread_mutex_t mutex;
+  /* signaled when a task is queued or finished or pool stops */
+  pthread_cond_t changed;
+  int stop;
+};
+
+/* Pool and deque of thread running this */
+static __thread const gsl_monte_pool2 *thread_pool = 0;
+static __thread size_t thread_deque = 0;
+
+static size_t
+own_deque (const gsl_monte_pool2 * pool)
+{
+  return thread_pool == pool ? thread_deque : 0;
+}
+
+static void
+push_bottom (task_deque * deque, gsl_monte_pool2_task * task)
+{
+  task->prev = deque->bottom;
+  task->next = 0;
+
+  if (deque->bottom == 0)
+    {
+      deque->top = task;
+    }
+  else
+    {
+      deque->bottom->next = task;
+    }
+  deque->bottom = task;
+}
+
+static gsl_monte_pool2_task *
+pop_bottom (task_deque * deque)
+{
+  gsl_monte_pool2_task *task = deque->bottom;
+
+  if (task != 0)
+    {
+      deque->bottom = task->prev;
+      if (deque->bottom == 0)
+        {
+          deque->top = 0;
+        }
+      else
+        {
+          deque->bottom->next = 0;
+        }
+    }
+
+  return task;
+}
+
+static gsl_monte_pool2_task *
+pop_top (task_deque * deque)
+{
+  gsl_monte_pool2_task *task = deque->top;
+
+  if (task != 0)
+    {
+      deque->top = task->next;
+      if (deque->top == 0)
+        {
+          deque->bottom = 0;
+        }
+      else
+        {
+          deque->top->prev = 0;
+        }
+    }
+
+  return task;
+}
+
+/* Removes newest task of given deque or steals oldest task of next
+   deque that has one, pool must be locked */
+static gsl_monte_pool2_task *
+pop_task (gsl_monte_pool2 * pool, size_t own)
+{
+  size_t i;
+  gsl_monte_pool2_task *task = pop_bottom (&pool->deques[own]);
+
+  for (i = 1; task == 0 && i < pool->size; i++)
+    {
+      task = pop_top (&pool->deques[(own + i) % pool->size]);
+    }
+
+  return task;
+}
+
+/* Runs task with pool unlocked, pool must be locked */
+static void
+run_task (gsl_monte_pool2 * pool, gsl_monte_pool2_task * task)
+{
+  pthread_mutex_unlock (&pool->mutex);
+  task->run (task->arg);
+  pthread_mutex_lock (&pool->mutex);
+
+  task->done = 1;
+  pthread_cond_broadcast (&pool->changed);
+}
+
+static void *
+run_thread (void *arg)
+{
+  gsl_monte_pool2 *pool = (gsl_monte_pool2 *) arg;
+
+  pthread_mutex_lock (&pool->mutex);
+
+  thread_pool = pool;
+  thread_deque = ++pool->nr_started;
+
+  while (1)
+    {
+      gsl_monte_pool2_task *task = pop_task (pool, thread_deque);
+
+      if (task != 0)
+        {
+          run_task (pool, task);
+        }
+      else if (pool->stop)
+        {
+          break;
+        }
+      else
+        {
+          pthread_cond_wait (&pool->changed, &pool->mutex);
+        }
+    }
+
+  pthread_mutex_unlock (&pool->mutex);
+
+  return 0;
+}
+
+gsl_monte_pool2 *
+gsl_monte_pool2_alloc (size_t size)
+{
+  size_t i;
+  gsl_monte_pool2 *pool;
+
+  if (size == 0)
+    {
+      return 0;
+    }
+
+  pool = (gsl_monte_pool2 *) malloc (sizeof (gsl_monte_pool2));
+  if (pool == 0)
+    {
+      return 0;
+    }
+
+  pool->threads = (pthread_t *) malloc (size * sizeof (pthread_t));
+  pool->deques = (task_deque *) calloc (size, sizeof (task_deque));
+  if (pool->threads == 0 || pool->deques == 0)
+    {
+      free (pool->threads);
+      free (pool->deques);
+      free (pool);
+      return 0;
+    }
+
+  pool->size = size;
+  pool->nr_threads = 0;
+  pool->nr_started = 0;
+  pool->stop = 0;
+  pthread_mutex_init (&pool->mutex, 0);
+  pthread_cond_init (&pool->changed, 0);
+
+  for (i = 1; i < size; i++)
+    {
+      if (pthread_create (&pool->threads[pool->nr_threads], 0, &run_thread, pool) != 0)
+        {
+          gsl_monte_pool2_free (pool);
+          return 0;
+        }
+      pool->nr_threads++;
+    }
+
+  return pool;
+}
+
+void
+gsl_monte_pool2_free (gsl_monte_pool2 * pool)
+{
+  size_t i;
+
+  if (pool == 0)
+    {
+      return;
+    }
+
+  pthread_mutex_lock (&pool->mutex);
+  pool->stop = 1;
+  pthread_cond_broadcast (&pool->changed);
+  pthread_mutex_unlock (&pool->mutex);
+
+  for (i = 0; i < pool->nr_threads; i++)
+    {
+      pthread_join (pool->threads[i], 0);
+    }
+
+  pthread_cond_destroy (&pool->changed);
+  pthread_mutex_destroy (&pool->mutex);
+  free (pool->deques);
+  free (pool->threads);
+  free (pool);
+}
+
+size_t
+gsl_monte_pool2_size (const gsl_monte_pool2 * pool)
+{
+  return pool->size;
+}
+
+void
+gsl_monte_pool2_spawn (gsl_monte_pool2 * pool, gsl_monte_pool2_task * task)
+{
+  task->done = 0;
+
+  pthread_mutex_lock (&pool->mutex);
+
+  push_bottom (&pool->deques[own_deque (pool)], task);
+
+  pthread_cond_broadcast (&pool->changed);
+  pthread_mutex_unlock (&pool->mutex);
+}
+
+void
+gsl_monte_pool2_wait (gsl_monte_pool2 * pool, gsl_monte_pool2_task * task)
+{
+  const size_t own = own_deque (pool);
+
+  pthread_mutex_lock (&pool->mutex);
+
+  while (!task->done)
+    {
+      gsl_monte_pool2_task *other = pop_task (pool, own);
+
+      if (other != 0)
+        {
+          run_task (pool, other);
+        }
+      else
+        {
+          pthread_cond_wait (&pool->changed, &pool->mutex);
+        }
+    }
+
+  pthread_mutex_unlock (&pool->mutex);
+}
@@ -84,7 +84,8 @@ static void init_box_coord (gsl_monte_vegas_state * s, coord box[]);
 static int change_box_coord (gsl_monte_vegas_state * s, coord box[]);
 static void accumulate_distribution (gsl_monte_vegas_state * s, coord bin[],
                                      double y);
-static void random_point (double x[], coord bin[], double *bin_vol,
+static void random_point (double x[], size_t x_stride,
+                          coord bin[], double *bin_vol,
                           const coord box[], 
                           const double xl[], const double xu[],
                           gsl_monte_vegas_state * s, gsl_rng * r);
@@ -111,9 +112,27 @@ gsl_monte_vegas_integrate2 (gsl_monte_function * f,
                            gsl_rng * r,
                            gsl_monte_vegas_state * state,
                            double *result, double *abserr, int* split_dims)
+{
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, f, state->x);
+  return gsl_monte_vegas_integrate2_batch (&batch, xl, xu, dim, calls, r,
+                                           state, result, abserr,
+                                           split_dims);
+}
+
+int
+gsl_monte_vegas_integrate2_batch (const gsl_monte_batch2_function * f,
+                           double xl[], double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_vegas_state * state,
+                           double *result, double *abserr, int* split_dims)
 {
   double cum_int, cum_sig;
   size_t i, k, it;
+  const size_t stride = GSL_MONTE_BATCH2_BLOCK;
 
   if (dim != state->dim)
     {
@@ -217,9 +236,19 @@ gsl_monte_vegas_integrate2 (gsl_monte_function * f,
 
   double* quad_avgs = (double*) calloc(2*dim, sizeof(double));
   int* quad_nr = (int*) calloc(2*dim, sizeof(int));
-  if (quad_avgs == NULL || quad_nr == NULL) {
+  /* block of points followed by their values and bin volumes, and bins
+     of points one point after another */
+  double* block_x = (double*) malloc((dim + 2) * stride * sizeof(double));
+  coord* block_bin = (coord*) malloc(dim * stride * sizeof(coord));
+  if (quad_avgs == NULL || quad_nr == NULL || block_x == NULL || block_bin == NULL) {
+    free(quad_avgs);
+    free(quad_nr);
+    free(block_x);
+    free(block_bin);
     return GSL_FAILURE;
   }
+  double* fvals = block_x + dim * stride;
+  double* bin_vols = fvals + stride;
 
   for (it = 0; it < state->iterations; it++)
     {
@@ -228,30 +257,46 @@ gsl_monte_vegas_integrate2 (gsl_monte_function * f,
       double wgt, var, sig;
       size_t calls_per_box = state->calls_per_box;
       double jacbin = state->jac;
-      double *x = state->x;
-      coord *bin = state->bin;
+      /* index of next generated point in its box */
+      size_t box_k = 0;
+      int boxes_left = 1;
+      volatile double m = 0, q = 0;
 
       state->it_num = state->it_start + it;
 
       reset_grid_values (state);
       init_box_coord (state, state->box);
-      
-      do
+
+      /* points are generated a block at a time going through boxes in
+         the same order as one at a time, statistics of a box are
+         accumulated when its last point has been evaluated */
+      k = 0;
+      while (boxes_left)
         {
-          volatile double m = 0, q = 0;
-          double f_sq_sum = 0.0;
+          size_t p, block;
 
-          for (k = 0; k < calls_per_box; k++)
+          for (block = 0; block < stride && boxes_left; block++)
             {
-              volatile double fval;
-              double bin_vol;
+              random_point (block_x + block, stride, block_bin + block * dim,
+                            &bin_vols[block], state->box, xl, xu, state, r);
 
-              random_point (x, bin, &bin_vol, state->box, xl, xu, state, r);
+              if (++box_k == calls_per_box)
+                {
+                  box_k = 0;
+                  boxes_left = change_box_coord (state, state->box);
+                }
+            }
+
+          GSL_MONTE_BATCH2_EVAL (f, block_x, block, stride, fvals);
 
-              fval = jacbin * bin_vol * GSL_MONTE_FN_EVAL (f, x);
+          for (p = 0; p < block; p++)
+            {
+              volatile double fval = jacbin * bin_vols[p] * fvals[p];
+              coord *bin = block_bin + p * dim;
 
               for (unsigned int d = 0; d < dim; d++) {
-                if (x[d] - xl[d] < xu[d] - x[d]) {
+                const double x = block_x[d * stride + p];
+                if (x - xl[d] < xu[d] - x) {
                   quad_avgs[d] += fval;
                   quad_nr[d]++;
                 } else {
@@ -273,20 +318,28 @@ gsl_monte_vegas_integrate2 (gsl_monte_function * f,
                   double f_sq = fval * fval;
                   accumulate_distribution (state, bin, f_sq);
                 }
-            }
 
-          intgrl += m * calls_per_box;
+              if (++k == calls_per_box)
+                {
+                  double f_sq_sum;
 
-          f_sq_sum = q * calls_per_box;
+                  intgrl += m * calls_per_box;
 
-          tss += f_sq_sum;
+                  f_sq_sum = q * calls_per_box;
 
-          if (state->mode == GSL_VEGAS_MODE_STRATIFIED)
-            {
-              accumulate_distribution (state, bin, f_sq_sum);
+                  tss += f_sq_sum;
+
+                  if (state->mode == GSL_VEGAS_MODE_STRATIFIED)
+                    {
+                      accumulate_distribution (state, bin, f_sq_sum);
+                    }
+
+                  k = 0;
+                  m = 0;
+                  q = 0;
+                }
             }
         }
-      while (change_box_coord (state, state->box));
 
       /* Compute final results for this iteration   */
 
@@ -401,9 +454,67 @@ gsl_monte_vegas_integrate2 (gsl_monte_function * f,
   }
   (*(split_dims + max_diff_d))++;
 
+  free(quad_avgs);
+  free(quad_nr);
+  free(block_x);
+  free(block_bin);
+
   return GSL_SUCCESS;
 }
 
+int
+gsl_monte_vegas_integrate2_continue (gsl_monte_function * f,
+                           double xl[], double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_vegas_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  gsl_monte_batch2_function batch;
+  gsl_monte_batch2_scalar scalar;
+
+  gsl_monte_batch2_from_scalar (&batch, &scalar, f, state->x);
+  return gsl_monte_vegas_integrate2_batch_continue (&batch, xl, xu, dim,
+                                                    calls, r, state, result,
+                                                    abserr, split_dims);
+}
+
+int
+gsl_monte_vegas_integrate2_batch_continue (const gsl_monte_batch2_function * f,
+                           double xl[], double xu[],
+                           size_t dim, size_t calls,
+                           gsl_rng * r,
+                           gsl_monte_vegas_state * state,
+                           double *result, double *abserr, int* split_dims)
+{
+  unsigned int iterations = state->iterations;
+  double calls_per_iteration;
+  int status;
+
+  if (state->stage == 0)
+    {
+      return gsl_monte_vegas_integrate2_batch (f, xl, xu, dim, calls, r,
+                                               state, result, abserr,
+                                               split_dims);
+    }
+
+  /* keep grid and accumulated results, add iterations with same
+     number of calls as before so that given calls add as many samples
+     as they would in a new integration */
+  calls_per_iteration = (double) state->calls_per_box
+                        * gsl_pow_int ((double) state->boxes, dim);
+  state->iterations = GSL_MAX (1, floor (iterations * calls / calls_per_iteration + 0.5));
+  state->stage = 3;
+
+  status = gsl_monte_vegas_integrate2_batch (f, xl, xu, dim, calls, r,
+                                             state, result, abserr,
+                                             split_dims);
+
+  state->iterations = iterations;
+
+  return status;
+}
+
 double
 gsl_monte_vegas_chisq (const gsl_monte_vegas_state * s)
 {
@@ -531,13 +642,15 @@ accumulate_distribution (gsl_monte_vegas_state * s, coord bin[], double y)
 }
 
 static void
-random_point (double x[], coord bin[], double *bin_vol,
+random_point (double x[], size_t x_stride,
+              coord bin[], double *bin_vol,
               const coord box[], const double xl[], const double /*xu*/[],
               gsl_monte_vegas_state * s, gsl_rng * r)
 {
   /* Use the random number generator r to return a random position x
      in a given box.  The value of bin gives the bin location of the
-     random position (there may be several bins within a given box) */
+     random position (there may be several bins within a given box).
+     Coordinate j of the position is written to x[j * x_stride]. */
 
   double vol = 1.0;
 
@@ -571,7 +684,7 @@ random_point (double x[], coord bin[], double *bin_vol,
           y = COORD (s, k, j) + (z - k) * bin_width;
         }
 
-      x[j] = xl[j] + y * s->delx[j];
+      x[j * x_stride] = xl[j] + y * s->delx[j];
 
       vol *= bin_width;
     }
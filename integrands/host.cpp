@@ -0,0 +1,597 @@
+/*
+Program that integrates volumes concurrently with copies of an integrand shared object.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "algorithm"
+#include "cerrno"
+#include "condition_variable"
+#include "cstdlib"
+#include "cstring"
+#include "deque"
+#include "ios"
+#include "iostream"
+#include "map"
+#include "memory"
+#include "mutex"
+#include "streambuf"
+#include "string"
+#include "thread"
+#include "vector"
+
+#include "dlfcn.h"
+#include "sys/socket.h"
+#include "sys/un.h"
+#include "unistd.h"
+
+#include "plugin.h"
+#include "protocol.hpp"
+
+
+/*
+Line that clients of socket send first, followed by " continue" if they
+send continued requests.
+
+Host repeats the line to accept client, otherwise writes the reason
+and disconnects.
+*/
+constexpr char host_hello[] = "hdintegrator host 1";
+
+
+/*
+Functions of integrand shared object, optional ones are null if not provided.
+*/
+struct Plugin {
+	decltype(&hdintegrator_init) init = nullptr;
+	decltype(&hdintegrator_integrate) integrate = nullptr;
+	decltype(&hdintegrator_integrate_client) integrate_client = nullptr;
+	decltype(&hdintegrator_forget_client) forget_client = nullptr;
+	decltype(&hdintegrator_seed) seed = nullptr;
+	decltype(&hdintegrator_teardown) teardown = nullptr;
+};
+
+
+/*
+One request and its result once done is true.
+
+Samples are kept for continuing the request only if keep_samples is
+true, separately for every client. Job with forget true only frees
+samples of its client.
+*/
+struct Job {
+	Integration_Request request;
+	unsigned long client = 0;
+	bool keep_samples = false, forget = false;
+	double value = 0, error = 0, halves[4];
+	std::vector<double> scores;
+	int split_dim = 0;
+	bool done = false, failed = false;
+};
+
+
+/*
+Requests waiting for or being integrated by every thread.
+
+Continued requests are given to the thread that integrated the same
+volume previously, because only its copy of integrand has the samples.
+Other requests are given to the thread with fewest jobs.
+*/
+struct Jobs {
+	std::mutex mutex;
+	std::condition_variable queued, finished;
+	std::vector<std::deque<std::shared_ptr<Job>>> queues;
+	std::vector<size_t> nr_jobs;
+	bool end_of_input = false;
+};
+
+
+/*
+Results of requests read from one input, in the same order as requests.
+
+Samples of requests are kept only if continuation is true. Results and
+end_of_input are protected by mutex of Jobs.
+*/
+struct Connection {
+	unsigned long client = 0;
+	bool continuation = false;
+	std::deque<std::shared_ptr<Job>> results;
+	bool end_of_input = false;
+};
+
+
+/*
+Integrates jobs of given thread with given copy of integrand until end of input.
+
+Time spent integrating every job is recorded in given trace.
+*/
+void integrate(const Plugin& plugin, void* const handle, const size_t thread_i, Jobs& jobs, Trace& trace)
+{
+	const std::string track = "thread " + std::to_string(thread_i);
+
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs.mutex);
+			jobs.queued.wait(lock, [&]{
+				return jobs.end_of_input or jobs.queues[thread_i].size() > 0;
+			});
+			if (jobs.queues[thread_i].size() == 0) {
+				return;
+			}
+			job = jobs.queues[thread_i].front();
+			jobs.queues[thread_i].pop_front();
+		}
+
+		if (job->forget) {
+			if (plugin.forget_client != nullptr) {
+				plugin.forget_client(handle, job->client);
+			}
+			continue;
+		}
+
+		const auto& request = job->request;
+		job->scores.resize(request.mins.size());
+		const double start = trace.enabled() ? Trace::now() : 0;
+		// without clients samples of all connections would be kept together
+		const auto ret_val
+			= plugin.integrate_client != nullptr
+			? plugin.integrate_client(
+				handle,
+				job->client,
+				job->keep_samples ? 1 : 0,
+				request.mins.size(),
+				request.mins.data(),
+				request.maxs.data(),
+				request.calls,
+				request.continued ? 1 : 0,
+				&job->value,
+				&job->error,
+				&job->split_dim,
+				job->halves,
+				job->scores.data()
+			)
+			: plugin.integrate(
+				handle,
+				request.mins.size(),
+				request.mins.data(),
+				request.maxs.data(),
+				request.calls,
+				request.continued ? 1 : 0,
+				&job->value,
+				&job->error,
+				&job->split_dim,
+				job->halves,
+				job->scores.data()
+			);
+		if (trace.enabled()) {
+			trace.span(track, "integrate", start, Trace::now(), (request.continued ? "+" : "") + std::to_string(request.calls));
+		}
+
+		std::lock_guard<std::mutex> lock(jobs.mutex);
+		job->failed = ret_val != 0;
+		job->done = true;
+		jobs.nr_jobs[thread_i]--;
+		jobs.finished.notify_all();
+	}
+}
+
+
+/*
+Writes results of given connection in order of requests until its end of input.
+
+Returns false and prints the reason to stderr if integration failed.
+*/
+bool write(Integrand_IO& io, Jobs& jobs, Connection& connection)
+{
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs.mutex);
+			jobs.finished.wait(lock, [&]{
+				return
+					(connection.results.size() > 0 and connection.results.front()->done)
+					or (connection.end_of_input and connection.results.size() == 0);
+			});
+			if (connection.results.size() == 0) {
+				return true;
+			}
+			job = connection.results.front();
+			connection.results.pop_front();
+		}
+
+		if (job->failed) {
+			std::cerr << "Integration failed." << std::endl;
+			return false;
+		}
+		io.write(job->value, job->error, job->split_dim, job->halves, job->scores.data(), job->scores.size());
+	}
+}
+
+
+/*
+Queues requests read with given io to threads until end of input.
+
+Returns false and prints the reason to stderr if input was invalid.
+*/
+bool queue_requests(Integrand_IO& io, Jobs& jobs, Connection& connection)
+{
+	// thread that integrated each volume since latest continued request
+	std::map<std::vector<double>, size_t> owners;
+	bool previous_continued = false;
+
+	while (true) {
+		auto job = std::make_shared<Job>();
+		job->client = connection.client;
+		job->keep_samples = connection.continuation;
+		try {
+			if (not io.read(job->request)) {
+				return true;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+
+		const auto& request = job->request;
+		if (not request.continued and previous_continued) {
+			owners.clear();
+		}
+		previous_continued = request.continued;
+
+		std::vector<double> extents(request.mins);
+		extents.insert(extents.end(), request.maxs.cbegin(), request.maxs.cend());
+
+		std::lock_guard<std::mutex> lock(jobs.mutex);
+		size_t thread_i = std::distance(
+			jobs.nr_jobs.cbegin(),
+			std::min_element(jobs.nr_jobs.cbegin(), jobs.nr_jobs.cend())
+		);
+		const auto owner = owners.find(extents);
+		if (request.continued and owner != owners.cend()) {
+			thread_i = owner->second;
+		} else if (connection.continuation) {
+			owners[extents] = thread_i;
+		}
+		jobs.queues[thread_i].push_back(job);
+		jobs.nr_jobs[thread_i]++;
+		connection.results.push_back(job);
+		jobs.queued.notify_all();
+	}
+}
+
+
+/*
+Frees samples kept for given client by every thread after its queued requests.
+*/
+void forget(Jobs& jobs, const unsigned long client)
+{
+	std::lock_guard<std::mutex> lock(jobs.mutex);
+	for (auto& queue: jobs.queues) {
+		auto job = std::make_shared<Job>();
+		job->client = client;
+		job->forget = true;
+		queue.push_back(job);
+	}
+	jobs.queued.notify_all();
+}
+
+
+/*
+Reads from and writes to a file descriptor without buffering of its own.
+*/
+class Fd_Buffer : public std::streambuf {
+public:
+
+	Fd_Buffer(const int given_fd) :
+		fd(given_fd)
+	{
+		this->setg(this->input, this->input, this->input);
+	}
+
+protected:
+
+	int_type underflow() override {
+		const auto nr_read = ::read(this->fd, this->input, sizeof(this->input));
+		if (nr_read <= 0) {
+			return traits_type::eof();
+		}
+		this->setg(this->input, this->input, this->input + nr_read);
+		return traits_type::to_int_type(this->input[0]);
+	}
+
+	std::streamsize xsputn(const char* data, const std::streamsize size) override {
+		std::streamsize written = 0;
+		while (written < size) {
+			const auto ret_val = ::send(this->fd, data + written, size - written, MSG_NOSIGNAL);
+			if (ret_val < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return written;
+			}
+			written += ret_val;
+		}
+		return written;
+	}
+
+	int_type overflow(const int_type c) override {
+		if (traits_type::eq_int_type(c, traits_type::eof())) {
+			return traits_type::not_eof(c);
+		}
+		const char data = traits_type::to_char_type(c);
+		return this->xsputn(&data, 1) == 1 ? c : traits_type::eof();
+	}
+
+private:
+
+	const int fd;
+	char input[1 << 16];
+};
+
+
+/*
+Serves requests and results of one client of socket until it disconnects.
+
+Client that sends invalid input or whose integration fails is
+disconnected, other clients are served as before. Samples of client are
+kept separately from those of others with given id, and continuation
+is refused unless separate_clients is true.
+*/
+void serve(const int client, const unsigned long id, const bool separate_clients, Jobs& jobs)
+{
+	Fd_Buffer buffer(client);
+	std::istream in(&buffer);
+	std::ostream out(&buffer);
+
+	const std::string hello(host_hello), continue_hello = hello + " continue";
+	std::string line;
+	if (not std::getline(in, line) or (line != hello and line != continue_hello)) {
+		out << "expected " << hello << " as first line" << std::endl;
+		close(client);
+		return;
+	}
+	// clients would discard and continue samples of each other
+	if (line == continue_hello and not separate_clients) {
+		out << "integrand doesn't keep samples of clients separately (hdintegrator_integrate_client)" << std::endl;
+		close(client);
+		return;
+	}
+	out << line << std::endl;
+
+	Integrand_IO io(in, out);
+	Connection connection;
+	connection.client = id;
+	connection.continuation = line == continue_hello;
+
+	// client sees its input closed like when an integrand program exits
+	std::thread writer([&]{
+		if (not write(io, jobs, connection)) {
+			shutdown(client, SHUT_RDWR);
+		}
+	});
+	if (not queue_requests(io, jobs, connection)) {
+		shutdown(client, SHUT_RDWR);
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobs.mutex);
+		connection.end_of_input = true;
+		jobs.finished.notify_all();
+	}
+	writer.join();
+	forget(jobs, id);
+	close(client);
+}
+
+
+/*
+Accepts clients on unix socket at given path forever, serving each in its own thread.
+
+Returns only if socket couldn't be created.
+*/
+void serve_socket(const std::string& path, const bool separate_clients, Jobs& jobs)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path too long: " << path << std::endl;
+		return;
+	}
+	std::strcpy(address.sun_path, path.c_str());
+
+	const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server < 0) {
+		std::cerr << "Couldn't create socket: " << std::strerror(errno) << std::endl;
+		return;
+	}
+	unlink(path.c_str());
+	if (
+		bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+		or listen(server, SOMAXCONN) != 0
+	) {
+		std::cerr << "Couldn't listen on " << path << ": " << std::strerror(errno) << std::endl;
+		close(server);
+		return;
+	}
+
+	// 0 is client of stdin
+	unsigned long id = 1;
+	while (true) {
+		const int client = accept(server, nullptr, nullptr);
+		if (client < 0) {
+			if (errno == EINTR or errno == ECONNABORTED) {
+				continue;
+			}
+			std::cerr << "Couldn't accept client: " << std::strerror(errno) << std::endl;
+			close(server);
+			return;
+		}
+		std::thread(serve, client, id++, separate_clients, std::ref(jobs)).detach();
+	}
+}
+
+
+/*
+Reads integration volumes from stdin and prints the results to stdout
+in the same format as other integrands, see protocol.hpp.
+
+Usage: host [--threads N] [--socket PATH] integrand.so [arguments of integrand]
+
+Every thread integrates with its own copy of integrand, i.e. with its
+own gsl state and random number generator, so requests are integrated
+in parallel when several are given before reading their results, as
+hdintegrator.py does with --max-batch. Copies of integrand share the
+cores given by environment variable HDINTEGRATOR_THREADS, or all cores
+if not set, by getting it divided by number of threads in their
+environment.
+
+With --socket requests are read from and results written to every
+client connected to unix socket at PATH instead, e.g. worker ranks of
+hdintegrator.py on the same node with --integrand-host PATH, until the
+host is killed. Clients start with host_hello.
+*/
+int main(int argc, char* argv[])
+{
+	std::ios_base::sync_with_stdio(false);
+
+	size_t nr_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::string socket_path;
+	int plugin_i = 1;
+	while (plugin_i + 1 < argc and std::string(argv[plugin_i]).substr(0, 2) == "--") {
+		const std::string option(argv[plugin_i]);
+		if (option == "--threads") {
+			try {
+				nr_threads = std::stoul(argv[plugin_i + 1]);
+			} catch (const std::exception& e) {
+				std::cerr << "Invalid number of threads: " << argv[plugin_i + 1] << std::endl;
+				return EXIT_FAILURE;
+			}
+		} else if (option == "--socket") {
+			socket_path = argv[plugin_i + 1];
+		} else {
+			break;
+		}
+		plugin_i += 2;
+	}
+	if (plugin_i >= argc or nr_threads == 0) {
+		std::cerr << "Usage: " << argv[0]
+			<< " [--threads N] [--socket PATH] integrand.so [arguments of integrand]"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+
+	size_t nr_cores = std::max(1u, std::thread::hardware_concurrency());
+	const char* const cores_str = std::getenv("HDINTEGRATOR_THREADS");
+	if (cores_str != nullptr and cores_str[0] != '\0') {
+		try {
+			nr_cores = std::max(1ul, std::stoul(cores_str));
+		} catch (const std::exception& e) {
+			std::cerr << "Invalid HDINTEGRATOR_THREADS: " << cores_str << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	// otherwise every copy of integrand would start a pool of all cores
+	const auto threads_per_copy = std::to_string(std::max(size_t(1), nr_cores / nr_threads));
+	setenv("HDINTEGRATOR_THREADS", threads_per_copy.c_str(), 1);
+
+	void* const library = dlopen(argv[plugin_i], RTLD_NOW | RTLD_LOCAL);
+	if (library == nullptr) {
+		std::cerr << "Couldn't load integrand: " << dlerror() << std::endl;
+		return EXIT_FAILURE;
+	}
+	Plugin plugin;
+	plugin.init = reinterpret_cast<decltype(plugin.init)>(dlsym(library, "hdintegrator_init"));
+	plugin.integrate = reinterpret_cast<decltype(plugin.integrate)>(dlsym(library, "hdintegrator_integrate"));
+	plugin.integrate_client = reinterpret_cast<decltype(plugin.integrate_client)>(dlsym(library, "hdintegrator_integrate_client"));
+	plugin.forget_client = reinterpret_cast<decltype(plugin.forget_client)>(dlsym(library, "hdintegrator_forget_client"));
+	plugin.seed = reinterpret_cast<decltype(plugin.seed)>(dlsym(library, "hdintegrator_seed"));
+	plugin.teardown = reinterpret_cast<decltype(plugin.teardown)>(dlsym(library, "hdintegrator_teardown"));
+	if (plugin.init == nullptr or plugin.integrate == nullptr or plugin.teardown == nullptr) {
+		std::cerr << "Integrand " << argv[plugin_i] << " doesn't implement plugin.h" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if ((plugin.integrate_client == nullptr) != (plugin.forget_client == nullptr)) {
+		std::cerr << "Integrand " << argv[plugin_i]
+			<< " implements only one of hdintegrator_integrate_client and hdintegrator_forget_client"
+			<< std::endl;
+		return EXIT_FAILURE;
+	}
+	// clients of socket tell whether they continue samples
+	if (socket_path.size() > 0) {
+		unsetenv("HDINTEGRATOR_CONTINUE");
+	}
+
+	// integrand gets its own name as first argument
+	std::vector<void*> handles;
+	for (size_t i = 0; i < nr_threads; i++) {
+		handles.push_back(plugin.init(argc - plugin_i, argv + plugin_i));
+		if (handles.back() == nullptr) {
+			std::cerr << "Couldn't initialize integrand" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (plugin.seed != nullptr and i > 0) {
+			plugin.seed(handles.back(), i);
+		}
+	}
+
+	Trace trace;
+	Jobs jobs;
+	jobs.queues.resize(nr_threads);
+	jobs.nr_jobs.resize(nr_threads, 0);
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < nr_threads; i++) {
+		threads.emplace_back(integrate, std::cref(plugin), handles[i], i, std::ref(jobs), std::ref(trace));
+	}
+
+	if (socket_path.size() > 0) {
+		serve_socket(socket_path, plugin.integrate_client != nullptr, jobs);
+		// clients might still be waiting for results
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	// exits like executable integrands if integration or input fails
+	Integrand_IO io;
+	Connection connection;
+	connection.continuation = continuation_enabled();
+	std::thread writer([&]{
+		if (not write(io, jobs, connection)) {
+			std::_Exit(EXIT_FAILURE);
+		}
+	});
+	if (not queue_requests(io, jobs, connection)) {
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobs.mutex);
+		jobs.end_of_input = true;
+		connection.end_of_input = true;
+		jobs.queued.notify_all();
+		jobs.finished.notify_all();
+	}
+	writer.join();
+	for (auto& thread: threads) {
+		thread.join();
+	}
+
+	for (auto* handle: handles) {
+		plugin.teardown(handle);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*
+Threads and random number generators for integrating one volume in parallel.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HDINTEGRATOR_INTEGRATION_THREADS_HPP
+#define HDINTEGRATOR_INTEGRATION_THREADS_HPP
+
+
+#include "cstdint"
+#include "cstdlib"
+#include "new"
+#include "stdexcept"
+#include "string"
+#include "vector"
+
+#include "gsl/gsl_rng.h"
+#include "gsl_monte_pool2.h"
+
+
+/*
+Pool of threads with one random number generator per thread.
+
+Generator i is seeded from seed of generator 0 and i so that every
+thread draws from its own stream and results of integration depend
+only on the seed and number of threads. With one thread there's no pool
+and generator 0 is seeded as in integrands without threads.
+*/
+class Integration_Threads {
+public:
+
+	/*
+	Returns number of threads given by environment variable
+	HDINTEGRATOR_THREADS or 1 if not set.
+
+	Throws std::invalid_argument if variable isn't a positive integer.
+	*/
+	static size_t default_size() {
+		const char* const value = std::getenv("HDINTEGRATOR_THREADS");
+		if (value == nullptr or value[0] == '\0') {
+			return 1;
+		}
+		// stoul would accept e.g. -1, 2x and leading whitespace
+		for (const char* c = value; *c != '\0'; c++) {
+			if (*c < '0' or *c > '9') {
+				throw std::invalid_argument("HDINTEGRATOR_THREADS must be a positive integer");
+			}
+		}
+		unsigned long size = 0;
+		try {
+			size = std::stoul(value);
+		} catch (const std::out_of_range&) {
+			throw std::invalid_argument("HDINTEGRATOR_THREADS is too large");
+		}
+		if (size == 0) {
+			throw std::invalid_argument("HDINTEGRATOR_THREADS must be > 0");
+		}
+		return size;
+	}
+
+	/*
+	Starts given number of threads including the calling one.
+
+	Throws std::bad_alloc if threads or generators couldn't be created.
+	*/
+	Integration_Threads(const size_t size) {
+		gsl_rng_env_setup();
+		// push_back mustn't throw after generators have been allocated
+		this->rngs.reserve(size);
+		for (size_t i = 0; i < size; i++) {
+			auto* const rng = gsl_rng_alloc(gsl_rng_default);
+			if (rng == nullptr) {
+				this->free();
+				throw std::bad_alloc();
+			}
+			this->rngs.push_back(rng);
+		}
+		this->seed(gsl_rng_default_seed);
+		this->threads = gsl_monte_pool2_alloc(size);
+		if (this->threads == nullptr) {
+			this->free();
+			throw std::bad_alloc();
+		}
+	}
+
+	Integration_Threads(const Integration_Threads&) = delete;
+	Integration_Threads& operator=(const Integration_Threads&) = delete;
+
+	~Integration_Threads() {
+		this->free();
+	}
+
+	/*
+	Seeds generator 0 with given seed and others with seeds derived from it.
+	*/
+	void seed(const unsigned long seed) {
+		gsl_rng_set(this->rngs[0], seed);
+		for (size_t i = 1; i < this->rngs.size(); i++) {
+			// splitmix64 of seed and thread
+			uint64_t mixed = seed + i * UINT64_C(0x9E3779B97F4A7C15);
+			mixed = (mixed ^ (mixed >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+			mixed = (mixed ^ (mixed >> 27)) * UINT64_C(0x94D049BB133111EB);
+			gsl_rng_set(this->rngs[i], mixed ^ (mixed >> 31));
+		}
+	}
+
+	size_t size() const {
+		return this->rngs.size();
+	}
+
+	gsl_rng* rng() {
+		return this->rngs[0];
+	}
+
+	gsl_rng** all_rngs() {
+		return this->rngs.data();
+	}
+
+	gsl_monte_pool2* pool() {
+		return this->threads;
+	}
+
+
+private:
+
+	std::vector<gsl_rng*> rngs;
+	gsl_monte_pool2* threads = nullptr;
+
+	/*
+	Frees pool and generators, also ones allocated by a constructor that throws.
+	*/
+	void free() {
+		gsl_monte_pool2_free(this->threads);
+		this->threads = nullptr;
+		for (auto* rng: this->rngs) {
+			gsl_rng_free(rng);
+		}
+		this->rngs.clear();
+	}
+};
+
+#endif // ifndef HDINTEGRATOR_INTEGRATION_THREADS_HPP
@@ -0,0 +1,100 @@
+#! /usr/bin/env python3
+'''
+Integrator program for N-sphere using midpoint rule to do the work.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+'''
+
+
+import argparse
+from sys import stdin, stdout
+from time import sleep
+
+
+'''
+Same as integrand in N-sphere.py.
+'''
+def integrand(r):
+	arg_for_sqrt = 1.0
+	for x in r:
+		arg_for_sqrt -= x**2
+	return max(0, arg_for_sqrt)**0.5
+
+
+'''
+Returns integral over given extents with midpoint rule of n points in every dimension.
+'''
+def midpoint(extents, n):
+	volume = 1.0
+	for extent in extents:
+		volume *= extent[1] - extent[0]
+	total = 0.0
+	for i in range(n**len(extents)):
+		r = []
+		for extent in extents:
+			r.append(extent[0] + (i % n + 0.5) * (extent[1] - extent[0]) / n)
+			i //= n
+		total += integrand(r)
+	return volume * total / n**len(extents)
+
+
+'''
+Reads integration volume from stdin and prints the result to stdout.
+
+Input format, line by line:
+nr_calls v0min v0max v1min v1max ...
+
+Unlike N-sphere.py results depend only on volume and nr_calls, which is
+rounded to the nearest n**dimensions points, so that cells converge only
+when they're small enough and results of runs can be compared exactly,
+e.g. in tests/restart.py. Error is the difference to midpoint rule with half as
+many points in every dimension and volume is split along its longest
+extent.
+
+Requests for volumes whose minimum in first dimension is at least
+--slow-from sleep --slow-delay seconds instead of --delay, e.g. for
+giving slow cells to more than one worker with --speculate in tests.
+'''
+if __name__ == '__main__':
+
+	parser = argparse.ArgumentParser()
+	parser.add_argument('--delay', type = float, default = 0, help = 'Sleep this many seconds before answering every request')
+	parser.add_argument('--slow-from', type = float, default = float('inf'), help = 'Sleep --slow-delay seconds instead for volumes starting at or above this in first dimension')
+	parser.add_argument('--slow-delay', type = float, default = 0, help = 'Seconds to sleep for volumes given by --slow-from')
+	args = parser.parse_args()
+
+	while True:
+		instr = stdin.readline()
+		if instr == '':
+			break
+		instr = instr.strip().split()
+		calls = float(instr[0].lstrip('+'))
+		extents = []
+		for i in range(2, len(instr), 2):
+			extents.append((float(instr[i - 1]), float(instr[i])))
+		n = max(1, int(round(calls**(1 / len(extents)))))
+		result = midpoint(extents, n)
+		error = abs(result - midpoint(extents, max(1, n // 2)))
+		split_dim = 0
+		for dim in range(len(extents)):
+			if extents[dim][1] - extents[dim][0] > extents[split_dim][1] - extents[split_dim][0]:
+				split_dim = dim
+		if extents[0][0] >= args.slow_from:
+			sleep(args.slow_delay)
+		else:
+			sleep(args.delay)
+		stdout.write('{:.15e} {:.15e} {:d}\n'.format(result, error, split_dim))
+		stdout.flush()
@@ -0,0 +1,116 @@
+/*
+C interface of integrands loaded by HDIntegrator as shared objects.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HDINTEGRATOR_PLUGIN_H
+#define HDINTEGRATOR_PLUGIN_H
+
+#include "stddef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Prepares integrand for integrating volumes.
+
+argc and argv are the same as command line of the executable version
+of integrand, argv[0] being the name of integrand.
+
+Returns handle to give to other functions, NULL on failure.
+*/
+void* hdintegrator_init(int argc, char* argv[]);
+
+/*
+Integrates volume from mins to maxs with given number of calls.
+
+If continued is non-zero calls are added to those of previous
+integration of same volume, as with + in the text protocol.
+Result is written to value, error and split_dim, and value and error of
+lower and upper half of volume along split_dim to halves[0..3], or NaN
+if integrand doesn't estimate them, and score of splitting volume along
+every dimension to scores[0..dimensions-1], higher meaning more need to
+split.
+
+Returns 0 on success.
+*/
+int hdintegrator_integrate(
+	void* handle,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+);
+
+/*
+Integrates like hdintegrator_integrate for one of several clients.
+
+Optional, hosts that serve several clients with the same copy of
+integrand call it instead if it exists. Samples are kept for continuing
+integrations only if keep_samples is non-zero, and are used and cleared
+only by requests of the same client, as if every client had a copy of
+integrand of its own.
+*/
+int hdintegrator_integrate_client(
+	void* handle,
+	unsigned long client,
+	int keep_samples,
+	size_t dimensions,
+	const double* mins,
+	const double* maxs,
+	double calls,
+	int continued,
+	double* value,
+	double* error,
+	int* split_dim,
+	double* halves,
+	double* scores
+);
+
+/*
+Frees samples kept for client of hdintegrator_integrate_client.
+
+Required if hdintegrator_integrate_client exists, called after client
+won't send more requests.
+*/
+void hdintegrator_forget_client(void* handle, unsigned long client);
+
+/*
+Seeds random number generator of integrand.
+
+Optional, hosts that run several copies of integrand in parallel call
+it if it exists so that copies don't use the same random numbers.
+*/
+void hdintegrator_seed(void* handle, unsigned long seed);
+
+/*
+Frees resources of integrand returned by hdintegrator_init.
+*/
+void hdintegrator_teardown(void* handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef HDINTEGRATOR_PLUGIN_H
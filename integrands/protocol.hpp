@@ -0,0 +1,356 @@
+/*
+Communication between HDIntegrator and integrand programs.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HDINTEGRATOR_PROTOCOL_HPP
+#define HDINTEGRATOR_PROTOCOL_HPP
+
+
+#include "chrono"
+#include "cmath"
+#include "cstdint"
+#include "cstdlib"
+#include "cstring"
+#include "deque"
+#include "fstream"
+#include "iomanip"
+#include "ios"
+#include "iostream"
+#include "mutex"
+#include "sstream"
+#include "stdexcept"
+#include "string"
+#include "vector"
+
+
+/*
+Line that switches both directions to binary protocol when it's the
+first line of input, integrand repeats it to confirm.
+*/
+constexpr char binary_hello[] = "hdintegrator binary 1";
+
+
+/*
+One integration requested by HDIntegrator.
+
+If continued is true calls should be added to those of previous
+integration of same volume instead of starting a new integration.
+*/
+struct Integration_Request {
+	double calls = 0;
+	bool continued = false;
+	std::vector<double> mins, maxs;
+};
+
+
+/*
+Returns whether HDIntegrator will send continued requests.
+
+hdintegrator.py sets environment variable HDINTEGRATOR_CONTINUE with
+--continue-samples. Integrands should keep samples of volumes for
+continuing their integration only if it's set.
+*/
+inline bool continuation_enabled() {
+	const char* const value = std::getenv("HDINTEGRATOR_CONTINUE");
+	return value != nullptr and value[0] != '\0';
+}
+
+
+/*
+Appends timings of integrand to file given by environment variable HDINTEGRATOR_TRACE.
+
+hdintegrator.py sets the variable with --trace. Every span is written as
+a line of start,end,track,event,cell,info with times in seconds since
+epoch, cell being empty as integrands don't know ids of cells, see
+Trace in hdintegrator.py. Lines are flushed when written so that they
+aren't lost if integrand is killed. Nothing is written if variable isn't
+set, spans can be recorded from several threads.
+*/
+class Trace {
+public:
+
+	Trace() {
+		const char* const path = std::getenv("HDINTEGRATOR_TRACE");
+		if (path != nullptr and path[0] != '\0') {
+			this->file.open(path, std::ios::app);
+			this->file << std::fixed << std::setprecision(6);
+		}
+	}
+
+	bool enabled() const {
+		return this->file.is_open();
+	}
+
+	/*
+	Returns current time in seconds since epoch.
+	*/
+	static double now() {
+		return std::chrono::duration<double>(
+			std::chrono::system_clock::now().time_since_epoch()
+		).count();
+	}
+
+	/*
+	Records that event took place on given track from start to end.
+	*/
+	void span(
+		const std::string& track,
+		const char* const event,
+		const double start,
+		const double end,
+		const std::string& info = ""
+	) {
+		if (not this->enabled()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->file << start << "," << end << "," << track << "," << event << ",," << info << std::endl;
+	}
+
+
+private:
+
+	std::ofstream file;
+	std::mutex mutex;
+};
+
+
+/*
+Reads requests from stdin and writes results to stdout, or given streams, in text or binary format.
+
+Text format is described in README.md. In binary format every request
+and result is a frame starting with number of bytes that follow as
+uint32_t. Request frames contain flags as uint32_t (bit 0 set if
+continued), number of dimensions as uint32_t, number of calls as double
+and minimum and maximum extent of every dimension as doubles in order
+min0 max0 min1 max1 ... Result frames contain value and error as double
+followed by split dimension as int32_t and optionally value and error of
+lower and upper half of volume along split dimension as doubles,
+optionally followed by score of every dimension as doubles. Frame
+with zero bytes ends input. All values are in native byte order.
+
+Memory of request is reused between requests. Time from reading a
+request to writing its result is recorded in trace, results being
+written in the same order as requests were read. Programs should call
+std::ios_base::sync_with_stdio(false) at the start of main() for faster
+standard streams, before anything is read or written.
+*/
+class Integrand_IO {
+public:
+
+	Trace trace;
+
+	Integrand_IO(std::istream& given_in = std::cin, std::ostream& given_out = std::cout) :
+		in(given_in),
+		out(given_out)
+	{
+		// results are flushed when written, reading mustn't flush them from another thread
+		this->in.tie(nullptr);
+		this->out << std::setprecision(15) << std::scientific;
+	}
+
+	/*
+	Reads next request into given one.
+
+	Returns false at end of input, throws std::runtime_error if input is invalid.
+	*/
+	bool read(Integration_Request& request) {
+		const bool ret_val = this->read_request(request);
+		if (ret_val and this->trace.enabled()) {
+			std::ostringstream info;
+			info << (request.continued ? "+" : "") << request.calls;
+			std::lock_guard<std::mutex> lock(this->requests_mutex);
+			this->requests.emplace_back(Trace::now(), info.str());
+		}
+		return ret_val;
+	}
+
+	/*
+	Writes result of latest request.
+
+	halves, if not null and not NaN, are value and error of lower half
+	followed by those of upper half of volume split along split_dim.
+	scores, if not null, are nr_scores scores of splitting volume along
+	every dimension, higher meaning more need to split. They follow the
+	halves, which are written as NaN if not available.
+	*/
+	void write(
+		const double value,
+		const double error,
+		const int split_dim,
+		const double* halves = nullptr,
+		const double* scores = nullptr,
+		const size_t nr_scores = 0
+	) {
+		this->write_result(value, error, split_dim, halves, scores, nr_scores);
+		if (this->trace.enabled()) {
+			std::lock_guard<std::mutex> lock(this->requests_mutex);
+			if (this->requests.size() > 0) {
+				this->trace.span("integrand", "request", this->requests.front().first, Trace::now(), this->requests.front().second);
+				this->requests.pop_front();
+			}
+		}
+	}
+
+
+private:
+
+	std::istream& in;
+	std::ostream& out;
+	bool binary = false, first_line = true;
+	std::string line;
+	std::vector<char> frame, result;
+	// read time and calls of requests without a result yet, oldest first
+	std::deque<std::pair<double, std::string>> requests;
+	std::mutex requests_mutex;
+
+	bool read_request(Integration_Request& request) {
+		if (this->binary) {
+			return this->read_frame(request);
+		}
+
+		if (not std::getline(this->in, this->line)) {
+			return false;
+		}
+		if (this->first_line) {
+			this->first_line = false;
+			if (this->line == binary_hello) {
+				this->out << binary_hello << std::endl;
+				this->binary = true;
+				return this->read_frame(request);
+			}
+		}
+
+		std::istringstream iss(this->line);
+		std::string calls_str;
+		iss >> calls_str;
+		request.mins.clear();
+		request.maxs.clear();
+		double item;
+		while (iss >> item) {
+			request.mins.push_back(item);
+			if (iss >> item) {
+				request.maxs.push_back(item);
+			} else {
+				break;
+			}
+		}
+		if (request.mins.size() == 0) {
+			return false;
+		}
+		if (request.mins.size() != request.maxs.size()) {
+			throw std::runtime_error("Number of minimum and maximum extents differs");
+		}
+		request.continued = calls_str[0] == '+';
+		request.calls = std::stod(calls_str);
+		return true;
+	}
+
+	void write_result(
+		const double value,
+		const double error,
+		const int split_dim,
+		const double* halves = nullptr,
+		const double* scores = nullptr,
+		const size_t nr_scores = 0
+	) {
+		const bool with_scores = scores != nullptr and nr_scores > 0;
+		const bool with_halves
+			= halves != nullptr
+			and not std::isnan(halves[0] + halves[1] + halves[2] + halves[3]);
+		const double nans[4]{NAN, NAN, NAN, NAN};
+		const double* const written_halves = with_halves ? halves : nans;
+
+		if (not this->binary) {
+			this->out << value << " " << error << " " << split_dim;
+			if (with_halves or with_scores) {
+				for (size_t i = 0; i < 4; i++) {
+					this->out << " " << written_halves[i];
+				}
+			}
+			if (with_scores) {
+				for (size_t i = 0; i < nr_scores; i++) {
+					this->out << " " << scores[i];
+				}
+			}
+			this->out << std::endl;
+			return;
+		}
+
+		const size_t halves_size
+			= (with_halves or with_scores) ? 4 * sizeof(double) : 0;
+		const size_t scores_size = with_scores ? nr_scores * sizeof(double) : 0;
+		const uint32_t size
+			= 2 * sizeof(double) + sizeof(int32_t) + halves_size + scores_size;
+		const int32_t dim = split_dim;
+		this->result.resize(sizeof(size) + size);
+		char* const result = this->result.data();
+		std::memcpy(result, &size, sizeof(size));
+		std::memcpy(result + sizeof(size), &value, sizeof(double));
+		std::memcpy(result + sizeof(size) + sizeof(double), &error, sizeof(double));
+		std::memcpy(result + sizeof(size) + 2 * sizeof(double), &dim, sizeof(dim));
+		const size_t halves_start = sizeof(size) + 2 * sizeof(double) + sizeof(dim);
+		if (halves_size > 0) {
+			std::memcpy(result + halves_start, written_halves, halves_size);
+		}
+		if (scores_size > 0) {
+			std::memcpy(result + halves_start + halves_size, scores, scores_size);
+		}
+		this->out.write(result, sizeof(size) + size);
+		this->out.flush();
+	}
+
+	bool read_frame(Integration_Request& request) {
+		uint32_t size = 0;
+		if (not this->in.read(reinterpret_cast<char*>(&size), sizeof(size)) or size == 0) {
+			return false;
+		}
+
+		this->frame.resize(size);
+		if (not this->in.read(this->frame.data(), size)) {
+			throw std::runtime_error("Incomplete request");
+		}
+
+		uint32_t flags = 0, dimensions = 0;
+		const size_t header_size = 2 * sizeof(uint32_t) + sizeof(double);
+		if (size < header_size) {
+			throw std::runtime_error("Request too short");
+		}
+		std::memcpy(&flags, this->frame.data(), sizeof(flags));
+		std::memcpy(&dimensions, this->frame.data() + sizeof(flags), sizeof(dimensions));
+		std::memcpy(&request.calls, this->frame.data() + 2 * sizeof(uint32_t), sizeof(double));
+		if (size != header_size + 2 * dimensions * sizeof(double)) {
+			throw std::runtime_error("Size of request doesn't match number of dimensions");
+		}
+		if (dimensions == 0) {
+			return false;
+		}
+
+		request.continued = (flags & 1) > 0;
+		request.mins.resize(dimensions);
+		request.maxs.resize(dimensions);
+		const char* extents = this->frame.data() + header_size;
+		for (size_t i = 0; i < dimensions; i++) {
+			std::memcpy(&request.mins[i], extents + 2 * i * sizeof(double), sizeof(double));
+			std::memcpy(&request.maxs[i], extents + (2 * i + 1) * sizeof(double), sizeof(double));
+		}
+		return true;
+	}
+};
+
+#endif // ifndef HDINTEGRATOR_PROTOCOL_HPP
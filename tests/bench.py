@@ -0,0 +1,169 @@
+#! /usr/bin/env python3
+'''
+Benchmarks HDIntegrator with C++ integrands.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import argparse
+import json
+from math import gamma, pi
+from os.path import abspath, dirname, join
+import shlex
+from subprocess import run, PIPE, TimeoutExpired
+from sys import stdout
+from time import time
+
+
+source_dir = dirname(dirname(abspath(__file__)))
+
+
+'''
+Returns integral of N-sphere integrand over [0, 1]**dimensions.
+
+Integrand is height of unit sphere of dimensions + 1 dimensions so its
+integral over the positive orthant is half the volume of that sphere
+divided by 2**dimensions.
+'''
+def n_sphere_value(dimensions):
+	n = dimensions + 1
+	return pi**(n / 2) / gamma(n / 2 + 1) / 2 / 2**dimensions
+
+
+'''
+Returns arguments of hdintegrator.py and analytic value of integral for given integrand in given dimensions.
+
+Analytic value is None if not known.
+'''
+def get_case(integrand, dimensions):
+	if integrand == 'N-sphere':
+		return ['--integrand', join(source_dir, 'integrands/N-sphere')], n_sphere_value(dimensions)
+	# lattice of dimensions points in x and one in t, without correlation
+	return [
+		'--integrand', join(source_dir, 'integrands/' + integrand),
+		'--args', '--corr1 -1 --corr2 -1 --nx ' + str(dimensions) + ' --nt 1',
+		'--min-extent', '-1', '--max-extent', '1'
+	], None
+
+
+'''
+Runs given command once and returns its wall time, output lines and return code.
+
+Raises TimeoutExpired if command takes longer than --timeout.
+'''
+def run_once(args, command):
+	start = time()
+	output = run(command, stdout = PIPE, timeout = args.timeout, universal_newlines = True)
+	return time() - start, output.stdout.split('\n'), output.returncode
+
+
+'''
+Runs hdintegrator.py --repeats times and returns results of run with median wall time as a dictionary.
+
+\param args Result from parse_args() of argparse.ArgumentParser in __main__.
+
+Numbers of evaluations and cells are read from --summary of the same
+run, rates are those numbers divided by its wall time.
+'''
+def bench(args, integrand, dimensions, ranks, calls):
+	case_args, analytic = get_case(integrand, dimensions)
+	command = shlex.split(args.mpiexec) + [
+		'-n', str(ranks),
+		join(source_dir, 'hdintegrator.py'),
+		'--dimensions', str(dimensions),
+		'--calls', str(calls),
+		'--summary'
+	] + case_args + shlex.split(args.hdintegrator_args)
+
+	result = {
+		'integrand': integrand,
+		'dimensions': dimensions,
+		'ranks': ranks,
+		'calls': calls,
+		'status': 'ok'
+	}
+	runs = []
+	try:
+		for i in range(max(1, args.repeats)):
+			runs.append(run_once(args, command))
+	except TimeoutExpired:
+		result['status'] = 'timeout'
+		return result
+	runs.sort(key = lambda item: item[0])
+	wall_time, lines, returncode = runs[len(runs) // 2]
+
+	try:
+		value, error, nan_fraction = [float(item) for item in lines[-2].split()]
+		# Received C cells integrated with E calls
+		summary = lines[-3].split()
+		cells, evaluations = int(summary[1]), float(summary[5])
+	except Exception:
+		result['status'] = 'failed'
+		return result
+	if returncode != 0:
+		result['status'] = 'failed'
+
+	result['wall_time'] = wall_time
+	result['wall_times'] = [item[0] for item in runs]
+	result['evaluations'] = evaluations
+	result['evaluations_per_second'] = evaluations / wall_time
+	result['cells'] = cells
+	result['cells_per_second'] = cells / wall_time
+	result['value'] = value
+	result['error'] = error
+	result['nan_fraction'] = nan_fraction
+	result['analytic'] = analytic
+	result['actual_error'] = None if analytic == None else abs(value - analytic)
+	return result
+
+
+if __name__ == '__main__':
+
+	parser = argparse.ArgumentParser(
+		description = 'Run HDIntegrator with C++ integrands over a grid of dimensions, rank counts and calls, see bench_compare.py',
+		formatter_class = argparse.ArgumentDefaultsHelpFormatter
+	)
+	parser.add_argument('--output', default = join(source_dir, 'tests/bench_out.json'), help = 'Write results to this JSON file')
+	parser.add_argument('--mpiexec', default = 'mpiexec', help = 'Command for starting MPI programs')
+	parser.add_argument('--integrands', default = 'N-sphere burgers_plain burgers_miser burgers_vegas', help = 'Integrands in integrands/ to run')
+	parser.add_argument('--dimensions', default = '2 4', help = 'Numbers of dimensions to run')
+	parser.add_argument('--ranks', default = '2 3', help = 'Numbers of MPI ranks to run')
+	parser.add_argument('--calls', default = '1e4 1e5', help = 'Values of --calls to run')
+	parser.add_argument('--timeout', type = float, default = 600, help = 'Fail a run that takes longer than this many seconds')
+	parser.add_argument('--repeats', type = int, default = 3, help = 'Run every case this many times and report the run with median wall time')
+	parser.add_argument('--hdintegrator-args', default = '', help = 'Further arguments to give to hdintegrator.py')
+	args = parser.parse_args()
+
+	results = []
+	for integrand in args.integrands.split():
+		for dimensions in [int(item) for item in args.dimensions.split()]:
+			for ranks in [int(item) for item in args.ranks.split()]:
+				for calls in [float(item) for item in args.calls.split()]:
+					print('BENCH', integrand, dimensions, 'dimensions', ranks, 'ranks', calls, 'calls... ', end = '')
+					stdout.flush()
+					result = bench(args, integrand, dimensions, ranks, calls)
+					results.append(result)
+					if result['status'] != 'ok':
+						print(result['status'].upper())
+						continue
+					print('{:.3f} s, {:.3e} evaluations/s, {:.3e} cells/s'.format(
+						result['wall_time'],
+						result['evaluations_per_second'],
+						result['cells_per_second']
+					))
+
+	with open(args.output, 'w') as out_file:
+		json.dump(results, out_file, indent = 1)
@@ -0,0 +1,97 @@
+#! /usr/bin/env python3
+'''
+Compares benchmark results of bench.py against a baseline.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import argparse
+import json
+from os.path import exists
+
+
+'''
+Returns identifier of benchmark case of given result.
+'''
+def get_key(result):
+	return result['integrand'], result['dimensions'], result['ranks'], result['calls']
+
+
+'''
+Returns list of problems of given result compared to given baseline.
+
+\param tolerance Allowed relative slowdown, e.g. 0.2 for 20 %.
+
+Wall time and evaluations and cells per second are compared, as well as
+actual error if analytic value of integral is known.
+'''
+def compare(result, baseline, tolerance):
+	if result['status'] != 'ok':
+		return [result['status']]
+	if baseline['status'] != 'ok':
+		return []
+
+	problems = []
+	if result['wall_time'] > (1 + tolerance) * baseline['wall_time']:
+		problems.append('wall time {:.3f} s vs {:.3f} s'.format(result['wall_time'], baseline['wall_time']))
+	for name in ['evaluations_per_second', 'cells_per_second']:
+		if result[name] * (1 + tolerance) < baseline[name]:
+			problems.append('{} {:.3e} vs {:.3e}'.format(name.replace('_', ' '), result[name], baseline[name]))
+	if \
+		result['actual_error'] != None \
+		and baseline['actual_error'] != None \
+		and result['actual_error'] > 10 * max(baseline['actual_error'], result['error']) \
+	:
+		problems.append('error {:.3e} vs {:.3e}'.format(result['actual_error'], baseline['actual_error']))
+	return problems
+
+
+if __name__ == '__main__':
+
+	parser = argparse.ArgumentParser(
+		description = 'Flag benchmark cases that are slower than in baseline, exit status is 1 if any was or if there is no baseline',
+		formatter_class = argparse.ArgumentDefaultsHelpFormatter
+	)
+	parser.add_argument('baseline', help = 'JSON file from bench.py to compare against')
+	parser.add_argument('results', help = 'JSON file from bench.py to compare')
+	parser.add_argument('--tolerance', type = float, default = 0.2, help = 'Flag cases slower than baseline by more than this fraction')
+	args = parser.parse_args()
+
+	if not exists(args.baseline):
+		print('No baseline', args.baseline, 'to compare against, record one with make bench-baseline')
+		exit(1)
+
+	with open(args.baseline) as baseline_file:
+		baselines = {get_key(result): result for result in json.load(baseline_file)}
+	with open(args.results) as results_file:
+		results = json.load(results_file)
+
+	slower = 0
+	for result in results:
+		key = get_key(result)
+		if key not in baselines:
+			print('NEW', *key)
+			continue
+		problems = compare(result, baselines[key], args.tolerance)
+		if len(problems) == 0:
+			print('OK', *key)
+		else:
+			slower += 1
+			print('SLOWER', *key, ':', ', '.join(problems))
+
+	print(slower, '/', len(results), 'cases slower than baseline')
+	if slower > 0:
+		exit(1)
@@ -0,0 +1,116 @@
+#! /usr/bin/env python3
+'''
+Tests splitting cells of Cell_Store of hdintegrator.py.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+'''
+
+from importlib.util import module_from_spec, spec_from_file_location
+from os.path import abspath, dirname, join
+import unittest
+
+
+source_dir = dirname(dirname(abspath(__file__)))
+spec = spec_from_file_location('hdintegrator', join(source_dir, 'hdintegrator.py'))
+hdintegrator = module_from_spec(spec)
+spec.loader.exec_module(hdintegrator)
+
+
+class Test_Cell_Store(unittest.TestCase):
+
+	def setUp(self):
+		self.extents = [(-1.0, 1.0), (0.0, 3.0), (2.0, 2.5)]
+		self.grid = hdintegrator.Cell_Store(len(self.extents))
+		self.grid.add(1, self.extents)
+
+	'''
+	Checks that given children cover parent with given extents and volume.
+	'''
+	def check_cover(self, children, extents, volume):
+		self.assertAlmostEqual(sum(self.grid.get_volume(c) for c in children), volume, delta = 1e-15 * volume)
+		for dim in range(len(extents)):
+			self.assertEqual(min(self.grid.get_extent(c, dim)[0] for c in children), extents[dim][0])
+			self.assertEqual(max(self.grid.get_extent(c, dim)[1] for c in children), extents[dim][1])
+
+	def test_add(self):
+		self.assertEqual(len(self.grid), 1)
+		self.assertIn(1, self.grid)
+		self.assertEqual(self.grid.get_extents(1), self.extents)
+		self.assertEqual(self.grid.get_volume(1), 3.0)
+		for name in ['value', 'error', 'estimate']:
+			self.assertEqual(self.grid.get(1, name), None)
+		self.assertFalse(self.grid.get(1, 'processing'))
+		self.assertFalse(self.grid.get(1, 'converged'))
+
+	def test_split(self):
+		self.grid.set(1, 'estimate', (1.0, 2.0))
+		children = self.grid.split(1, 1)
+		self.assertEqual(children, [2, 3])
+		self.assertNotIn(1, self.grid)
+		self.assertEqual(sorted(self.grid.get_cells()), [2, 3])
+		self.assertEqual(self.grid.get_extent(2, 1), (0.0, 1.5))
+		self.assertEqual(self.grid.get_extent(3, 1), (1.5, 3.0))
+		for c in children:
+			self.assertEqual(self.grid.get_extent(c, 0), self.extents[0])
+			self.assertEqual(self.grid.get_extent(c, 2), self.extents[2])
+			self.assertEqual(self.grid.get_volume(c), 1.5)
+			self.assertEqual(self.grid.get(c, 'estimate'), None)
+		self.check_cover(children, self.extents, 3.0)
+
+	def test_split_dimensions(self):
+		split_dims = [2, 0, 1]
+		children = hdintegrator.split(1, 1, split_dims, self.grid)
+		k = len(split_dims)
+		self.assertEqual(children, [2**k + i for i in range(2**k)])
+		self.assertEqual(len(self.grid), 2**k)
+		for i in range(2**k):
+			c = 2**k + i
+			for j in range(k):
+				# first dimension split is the most significant bit of i
+				upper = (i >> (k - 1 - j)) & 1
+				minimum, maximum = self.extents[split_dims[j]]
+				middle = (minimum + maximum) / 2
+				expected = (middle, maximum) if upper else (minimum, middle)
+				self.assertEqual(self.grid.get_extent(c, split_dims[j]), expected)
+			self.assertAlmostEqual(self.grid.get_volume(c), 3.0 / 2**k)
+		self.check_cover(children, self.extents, 3.0)
+
+	def test_split_child(self):
+		first = hdintegrator.split(1, 1, [0, 1], self.grid)
+		c = first[2]
+		extents = self.grid.get_extents(c)
+		volume = self.grid.get_volume(c)
+		children = hdintegrator.split(c, 1, [2, 1], self.grid)
+		self.assertEqual(children, [c * 4 + i for i in range(4)])
+		self.check_cover(children, extents, volume)
+		self.check_cover([cell for cell in first if cell != c] + children, self.extents, 3.0)
+
+	def test_reuse_slots(self):
+		children = self.grid.split(1, 0)
+		self.grid.set(children[0], 'converged', True)
+		self.grid.remove(children[0])
+		extents = self.grid.get_extents(children[1])
+		grandchildren = self.grid.split(children[1], 2)
+		self.assertEqual(grandchildren, [6, 7])
+		# slots of removed cells are reused, extents mustn't leak between cells
+		self.assertEqual(self.grid.get_extents(6), [(0.0, 1.0), (0.0, 3.0), (2.0, 2.25)])
+		self.assertEqual(self.grid.get_extents(7), [(0.0, 1.0), (0.0, 3.0), (2.25, 2.5)])
+		self.assertFalse(self.grid.get(6, 'converged'))
+		self.check_cover(grandchildren, extents, 1.5)
+
+
+if __name__ == '__main__':
+	unittest.main()
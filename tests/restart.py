@@ -0,0 +1,150 @@
+#! /usr/bin/env python3
+'''
+Tests restarting HDIntegrator from journals of killed and finished runs.
+
+Copyright 2017 Ilja Honkonen
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import argparse
+from os import remove
+from os.path import abspath, dirname, exists, join
+import shlex
+from subprocess import run, Popen, DEVNULL, PIPE
+from sys import executable, exit
+from time import sleep, time
+
+
+source_dir = dirname(dirname(abspath(__file__)))
+
+
+'''
+Returns command running hdintegrator.py with --restart given path.
+
+Cells are integrated with integrands/midpoint.py whose results depend
+only on volume of cells, so that value and cells of a restarted run are
+the same as those of an uninterrupted one.
+'''
+def get_command(args, path):
+	return shlex.split(args.mpiexec) + [
+		'-n', '2',
+		join(source_dir, 'hdintegrator.py'),
+		'--integrand', join(source_dir, 'integrands/midpoint.py'),
+		'--args', '--delay ' + str(args.delay),
+		'--dimensions', '2',
+		'--calls', '16',
+		'--convergence-factor', '1.0001',
+		'--convergence-diff', '1e-6',
+		'--min-value', '1e-6',
+		'--restart', path,
+		'--restart-interval', '1'
+	]
+
+
+'''
+Returns value, error and NaN volume fraction printed by finished run of given command.
+'''
+def run_to_end(command):
+	output = run(command, stdout = PIPE, universal_newlines = True)
+	if output.returncode != 0:
+		exit('Run failed: ' + ' '.join(command))
+	return [float(item) for item in output.stdout.split('\n')[-2].split()]
+
+
+'''
+Returns value, error, NaN volume fraction, number of converged cells and number of cells printed by --inspect of given journal.
+'''
+def inspect(path):
+	output = run([executable, join(source_dir, 'hdintegrator.py'), '--inspect', path], stdout = PIPE, universal_newlines = True)
+	# Value: V error: E NaN volume/total: N , C / T converged cells
+	items = output.stdout.split()
+	return float(items[1]), float(items[3]), float(items[6]), int(items[8]), int(items[10])
+
+
+'''
+Starts given command and kills it once journal at path has more than given number of converged cells.
+
+\return Number of converged cells in journal after killing.
+
+Exits if command finishes before that, as then the journal of a killed run isn't tested.
+'''
+def run_and_kill(command, path, converged):
+	process = Popen(command, stdout = DEVNULL)
+	while True:
+		sleep(0.2)
+		if process.poll() != None:
+			exit('Run finished before it could be killed, increase --delay')
+		if exists(path) and inspect(path)[3] > converged:
+			break
+	# ranks are killed without closing the journal
+	process.terminate()
+	process.wait()
+	return inspect(path)[3]
+
+
+'''
+Returns whether given floats are equal within rounding errors of summing them in different order.
+'''
+def close(a, b):
+	return abs(a - b) <= 1e-12 * max(abs(a), abs(b))
+
+
+if __name__ == '__main__':
+
+	parser = argparse.ArgumentParser(
+		description = 'Restart a finished HDIntegrator run twice, kill and restart another run twice and check that their results and journals match those of an uninterrupted run',
+		formatter_class = argparse.ArgumentDefaultsHelpFormatter
+	)
+	parser.add_argument('--mpiexec', default = 'mpiexec', help = 'Command for starting MPI programs')
+	parser.add_argument('--delay', type = float, default = 0.01, help = 'Seconds integrand sleeps per request so that runs can be killed before they finish')
+	args = parser.parse_args()
+
+	ref_path = join(source_dir, 'tests/restart_ref.journal')
+	out_path = join(source_dir, 'tests/restart_out.journal')
+	for path in [ref_path, out_path]:
+		if exists(path):
+			remove(path)
+
+	start = time()
+	ref_result = run_to_end(get_command(args, ref_path))
+	ref_info = inspect(ref_path)
+
+	# restarts of a finished run compact its journal and mustn't integrate anything
+	errors = []
+	for i in range(2):
+		finished_result = run_to_end(get_command(args, ref_path))
+		finished_info = inspect(ref_path)
+		if not all(close(ref, out) for ref, out in zip(ref_result, finished_result)):
+			errors.append('Result of restarted finished run {} differs from {}'.format(finished_result, ref_result))
+		if not all(close(ref, out) for ref, out in zip(ref_info[:3], finished_info[:3])) or ref_info[3:] != finished_info[3:]:
+			errors.append('Journal of restarted finished run {} differs from {}'.format(finished_info, ref_info))
+
+	# second restart reads a journal compacted by the first one,
+	# in which cells converged before first kill are only in totals
+	converged = 0
+	for i in range(2):
+		converged = run_and_kill(get_command(args, out_path), out_path, converged + 5)
+		if converged >= ref_info[3]:
+			exit('Run was killed after all cells converged, increase --delay')
+	out_result = run_to_end(get_command(args, out_path))
+	out_info = inspect(out_path)
+
+	if not all(close(ref, out) for ref, out in zip(ref_result, out_result)):
+		errors.append('Result of restarted run {} differs from {}'.format(out_result, ref_result))
+	if not all(close(ref, out) for ref, out in zip(ref_info[:3], out_info[:3])) or ref_info[3:] != out_info[3:]:
+		errors.append('Journal of restarted run {} differs from {}'.format(out_info, ref_info))
+	if len(errors) > 0:
+		exit('\n'.join(errors))
+	print('{} converged cells in {:.1f} s'.format(ref_info[3], time() - start))